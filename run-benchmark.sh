@@ -0,0 +1,46 @@
+#!/bin/bash
+
+find_qt_bin_windows() {
+  local qt_dir="C:/Qt"
+  if [ -d "$qt_dir" ]; then
+    local qt_bin=$(find "$qt_dir" -type d -name "bin" -print -quit)
+    if [ -n "$qt_bin" ]; then
+      echo "$qt_bin"
+    else
+      echo "Error: Qt bin directory not found."
+      exit 1
+    fi
+  else
+    echo "Error: Qt directory not found at $qt_dir."
+    exit 1
+  fi
+}
+
+if [[ "$OSTYPE" == "msys" ]] || [[ "$OSTYPE" == "cygwin" ]] || [[ "$OSTYPE" == "win32" ]]; then
+  QT_BIN_DIR=$(find_qt_bin_windows)
+  export PATH="$QT_BIN_DIR:$PATH"
+fi
+
+BUILD_PROJECT_DIR=$(find build -type d -name "build-projects-*-Release" -print -quit)
+
+if [ -z "$BUILD_PROJECT_DIR" ]; then
+  echo "Error: Build directory for the project not found."
+  exit 1
+fi
+
+EXECUTABLE_PATH="$BUILD_PROJECT_DIR/projects_ray_benchmark"
+FORMAT="${1:-json}"
+OUTPUT_FILE="benchmark_results.$FORMAT"
+
+# Microbenchmarks plus a full-frame render of every template scene, written as JSON or CSV. Scene loading logs to
+# stdout, so the results go straight to the file.
+if [ -x "$EXECUTABLE_PATH" ]; then
+  "$EXECUTABLE_PATH" --format "$FORMAT" --output "$OUTPUT_FILE" template_inis/*/*.ini
+elif [ -f "$EXECUTABLE_PATH.exe" ]; then
+  "$EXECUTABLE_PATH.exe" --format "$FORMAT" --output "$OUTPUT_FILE" template_inis/*/*.ini
+else
+  echo "Error: Executable $EXECUTABLE_PATH not found or is not executable."
+  exit 1
+fi
+
+echo "Saved benchmark results to $OUTPUT_FILE"
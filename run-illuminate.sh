@@ -29,18 +29,13 @@ if [ -z "$BUILD_PROJECT_DIR" ]; then
 fi
 
 EXECUTABLE_PATH="$BUILD_PROJECT_DIR/projects_ray"
-INI_FILE="template_inis/intersect/unit_cylinder.ini"
 
-for INI_FILE in template_inis/illuminate/*.ini; do
-  if [ -x "$EXECUTABLE_PATH" ] || [ -f "$EXECUTABLE_PATH.exe" ]; then
-    echo "Running $EXECUTABLE_PATH with $INI_FILE"
-    if [ -x "$EXECUTABLE_PATH" ]; then
-      "$EXECUTABLE_PATH" "$INI_FILE"
-    elif [ -f "$EXECUTABLE_PATH.exe" ]; then
-      "$EXECUTABLE_PATH.exe" "$INI_FILE"
-    fi
-  else
-    echo "Error: Executable $EXECUTABLE_PATH not found or is not executable."
-    exit 1
-  fi
-done
+# All configs render as one batch in a single process, sharing scenes and textures.
+if [ -x "$EXECUTABLE_PATH" ]; then
+  "$EXECUTABLE_PATH" template_inis/illuminate/*.ini
+elif [ -f "$EXECUTABLE_PATH.exe" ]; then
+  "$EXECUTABLE_PATH.exe" template_inis/illuminate/*.ini
+else
+  echo "Error: Executable $EXECUTABLE_PATH not found or is not executable."
+  exit 1
+fi
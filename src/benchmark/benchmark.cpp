@@ -0,0 +1,425 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QtCore>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <glm/gtx/transform.hpp>
+#include "utils/configreader.h"
+#include "utils/sceneparser.h"
+#include "raytracer/raytracer.h"
+#include "raytracer/raytracescene.h"
+#include "shapes/cone.h"
+#include "shapes/cube.h"
+#include "shapes/cylinder.h"
+#include "shapes/sphere.h"
+
+// Microbenchmarks for the hot paths of the ray tracer: primitive intersection, normals and UVs,
+// texture filtering and Phong shading, plus full-frame renders of any config files passed in.
+// Every measurement keeps the fastest of several repeats and is printed as JSON or CSV,
+// so runs can be compared across commits by a script.
+
+#define BENCHMARK_RAY_COUNT 4096
+#define BENCHMARK_TEXTURE_SIZE 512
+#define BENCHMARK_DEFAULT_REPEATS 5
+
+struct BenchmarkResult {
+    std::string name;
+    long long ops;    // Operations timed per repeat
+    long long rays;   // Rays traced per repeat, 0 if the benchmark does not trace rays
+    double seconds;   // Fastest repeat
+};
+
+// Keeps the compiler from discarding results that are otherwise unused.
+static volatile float g_sink;
+
+// Gives the benchmark access to RayTracer internals that are not part of its public API.
+class RayTracerBenchmark
+{
+public:
+    static glm::vec4 phong(RayTracer &raytracer, glm::vec3 position, glm::vec3 normal, glm::vec3 directionToCamera,
+                           const RayTraceScene &scene, const std::shared_ptr<Shape> &shape) {
+        return raytracer.phong(position, normal, directionToCamera, scene, shape, scene.getLightData(), glm::vec4(1.0f));
+    }
+};
+
+//  ===== HELPER FUNCTIONS ======
+
+// Runs body once to warm the caches, then repeats times, and returns the fastest run.
+template <typename Body>
+static BenchmarkResult measure(const std::string &name, long long ops, long long rays, int repeats, Body &&body) {
+
+    body();
+
+    double best = INFINITY;
+    for (int repeat = 0; repeat < repeats; repeat++) {
+
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+
+    }
+
+    return BenchmarkResult{name, ops, rays, best};
+
+}
+
+// Object space rays that start outside the unit cube and aim at a random point inside it,
+// so most of them hit each primitive and exercise the full intersection code.
+static std::vector<Ray> generateRays(int count) {
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+    std::vector<Ray> rays;
+    rays.reserve(count);
+
+    while ((int)rays.size() < count) {
+
+        glm::vec3 origin(uniform(rng), uniform(rng), uniform(rng));
+        if (glm::length(origin) < 0.1f) continue;
+        origin = 2.0f * glm::normalize(origin);
+
+        glm::vec3 target = 0.45f * glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+        glm::vec3 direction = glm::normalize(target - origin);
+
+        rays.push_back(Ray{origin, direction, direction});
+
+    }
+
+    return rays;
+
+}
+
+static std::vector<glm::vec2> generateUVs(int count) {
+
+    std::mt19937 rng(5678);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    std::vector<glm::vec2> uvs(count);
+    for (glm::vec2 &uv : uvs) {
+        uv = glm::vec2(uniform(rng), uniform(rng));
+    }
+
+    return uvs;
+
+}
+
+// An 8x8 checkerboard.
+static ImagePtr checkerboardImage(int size) {
+
+    RGBA *data = new RGBA[size * size];
+    int cell = std::max(size / 8, 1);
+
+    for (int j = 0; j < size; j++) {
+        for (int i = 0; i < size; i++) {
+            bool white = ((i / cell) + (j / cell)) % 2 == 0;
+            data[j * size + i] = white ? RGBA{255, 255, 255, 255} : RGBA{20, 40, 200, 255};
+        }
+    }
+
+    return ImagePtr(new Image{data, size, size});
+
+}
+
+// A small scene with one light of each type, used to shade points on its sphere.
+static RenderData shadingScene() {
+
+    RenderData data;
+    data.globalData = SceneGlobalData{0.5f, 0.5f, 0.5f, 1.0f};
+
+    data.cameraData.pos = glm::vec4(0, 0, 5, 1);
+    data.cameraData.look = glm::vec4(0, 0, -1, 0);
+    data.cameraData.up = glm::vec4(0, 1, 0, 0);
+    data.cameraData.heightAngle = 0.6f;
+    data.cameraData.aperture = 0.0f;
+    data.cameraData.focalLength = 5.0f;
+
+    data.lights = {
+        SceneLightData{0, LightType::LIGHT_POINT, glm::vec4(1.0f), glm::vec3(1, 0.05f, 0), glm::vec4(3, 3, 3, 1), glm::vec4(0), 0, 0, 0, 0},
+        SceneLightData{1, LightType::LIGHT_DIRECTIONAL, glm::vec4(0.5f), glm::vec3(1, 0, 0), glm::vec4(0), glm::vec4(-1, -2, -1, 0), 0, 0, 0, 0},
+        SceneLightData{2, LightType::LIGHT_SPOT, glm::vec4(0.7f), glm::vec3(1, 0, 0), glm::vec4(-2, 3, 2, 1), glm::vec4(0.5f, -1, -0.5f, 0), 0.1f, 0.5f, 0, 0},
+    };
+
+    SceneMaterial material;
+    material.clear();
+    material.cAmbient = glm::vec4(0.1f);
+    material.cDiffuse = glm::vec4(0.8f, 0.4f, 0.2f, 1.0f);
+    material.cSpecular = glm::vec4(1.0f);
+    material.shininess = 20.0f;
+
+    RenderShapeData floor{ScenePrimitive{PrimitiveType::PRIMITIVE_CUBE, material, ""},
+                          glm::translate(glm::vec3(0, -1, 0)) * glm::scale(glm::vec3(10, 0.1f, 10))};
+    RenderShapeData sphere{ScenePrimitive{PrimitiveType::PRIMITIVE_SPHERE, material, ""}, glm::mat4(1.0f)};
+    data.shapes = {sphere, floor};
+
+    return data;
+
+}
+
+//  ===== BENCHMARKS ======
+
+// Intersection, normals and UVs of one primitive type. The normal and UV loops reuse the hit points.
+static void benchmarkShape(const std::string &name, const Shape &shape, const std::vector<Ray> &rays,
+                           int repeats, std::vector<BenchmarkResult> &results) {
+
+    long long count = (long long)rays.size();
+
+    results.push_back(measure(name + "::rayIntersect", count, count, repeats, [&]() {
+        float sum = 0.0f;
+        for (const Ray &ray : rays) {
+            float t;
+            glm::vec3 hitPoint;
+            if (shape.rayIntersect(ray, t, hitPoint)) sum += t;
+        }
+        g_sink = sum;
+    }));
+
+    std::vector<glm::vec3> hitPoints;
+    for (const Ray &ray : rays) {
+        float t;
+        glm::vec3 hitPoint;
+        if (shape.rayIntersect(ray, t, hitPoint)) hitPoints.push_back(hitPoint);
+    }
+    if (hitPoints.empty()) return;
+
+    long long hits = (long long)hitPoints.size();
+
+    results.push_back(measure(name + "::computeNormal", hits, 0, repeats, [&]() {
+        float sum = 0.0f;
+        for (glm::vec3 &hitPoint : hitPoints) sum += shape.computeNormal(hitPoint).x;
+        g_sink = sum;
+    }));
+
+    results.push_back(measure(name + "::computeUV", hits, 0, repeats, [&]() {
+        float sum = 0.0f;
+        for (glm::vec3 &hitPoint : hitPoints) sum += shape.computeUV(hitPoint).x;
+        g_sink = sum;
+    }));
+
+}
+
+static void benchmarkTexture(int repeats, std::vector<BenchmarkResult> &results) {
+
+    SceneFileMap info;
+    info.clear();
+    info.isUsed = true;
+    info.repeatU = 4.0f;
+    info.repeatV = 4.0f;
+
+    Texture texture(checkerboardImage(BENCHMARK_TEXTURE_SIZE), info);
+
+    results.push_back(measure("Texture::generateMaps", 1, 0, repeats, [&]() {
+        texture.generateMaps();
+    }));
+
+    std::vector<glm::vec2> uvs = generateUVs(BENCHMARK_RAY_COUNT);
+    long long count = (long long)uvs.size();
+
+    // Sweep the mip levels so every level of the chain is sampled.
+    float maxLevel = (float)texture.m_levels.size() - 1.0f;
+    auto levelOf = [&](int index) { return maxLevel * (float)index / (float)count; };
+
+    results.push_back(measure("Texture::sampleNearest", count, 0, repeats, [&]() {
+        float sum = 0.0f;
+        for (const glm::vec2 &uv : uvs) sum += texture.sampleNearest(uv).x;
+        g_sink = sum;
+    }));
+
+    results.push_back(measure("Texture::sampleBilinear", count, 0, repeats, [&]() {
+        float sum = 0.0f;
+        for (int index = 0; index < (int)count; index++) sum += texture.sampleBilinear(uvs[index], levelOf(index), true).x;
+        g_sink = sum;
+    }));
+
+    results.push_back(measure("Texture::sampleTrilinear", count, 0, repeats, [&]() {
+        float sum = 0.0f;
+        for (int index = 0; index < (int)count; index++) {
+            float level = levelOf(index);
+            sum += texture.sampleTrilinear(uvs[index], level, true).x;
+        }
+        g_sink = sum;
+    }));
+
+}
+
+// Shades points on the sphere of shadingScene(), shadow rays included.
+static void benchmarkPhong(int repeats, std::vector<BenchmarkResult> &results) {
+
+    RayTracer::Config config{};
+    config.enableShadow = true;
+    config.enableAcceleration = true;
+
+    RayTracer raytracer{config};
+    RayTraceScene scene{64, 64, shadingScene()};
+    const std::shared_ptr<Shape> &sphere = scene.getShapeData()[0];
+
+    std::mt19937 rng(9012);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+    std::vector<glm::vec3> normals;
+    while ((int)normals.size() < BENCHMARK_RAY_COUNT) {
+        glm::vec3 normal(uniform(rng), uniform(rng), uniform(rng));
+        if (glm::length(normal) > 0.1f) normals.push_back(glm::normalize(normal));
+    }
+
+    glm::vec3 cameraPosition = scene.getCamera().position;
+    long long count = (long long)normals.size();
+
+    results.push_back(measure("RayTracer::phong", count, 0, repeats, [&]() {
+        float sum = 0.0f;
+        for (const glm::vec3 &normal : normals) {
+            glm::vec3 position = 0.5f * normal;
+            sum += RayTracerBenchmark::phong(raytracer, position, normal, cameraPosition - position, scene, sphere).x;
+        }
+        g_sink = sum;
+    }));
+
+}
+
+// Renders the scene of a config file the way the main executable does, without saving the image.
+// Reports primary rays per second; with the Adaptive pattern the ray count is an upper bound.
+static bool benchmarkFrame(const QString &configPath, int repeats, std::vector<BenchmarkResult> &results) {
+
+    QSettings settings(configPath, QSettings::IniFormat);
+    QString scenePath = settings.value("IO/scene").toString();
+
+    RenderData metaData;
+    if (!SceneParser::parse(scenePath.toStdString(), metaData)) {
+        std::cerr << "Error loading scene: \"" << scenePath.toStdString() << "\"" << std::endl;
+        return false;
+    }
+
+    int width = settings.value("Canvas/width").toInt();
+    int height = settings.value("Canvas/height").toInt();
+
+    RayTracer::Config rtConfig = ConfigReader::rayTracerConfig(settings);
+    if (rtConfig.textureFilterType == TextureFilterType::Trilinear && !rtConfig.enableMipMapping) {
+        std::cerr << "Error: Trilinear filtering requires mip-mapping: \"" << configPath.toStdString() << "\"" << std::endl;
+        return false;
+    }
+
+    RayTracer raytracer{rtConfig};
+    RayTraceScene rtScene{width, height, metaData};
+    std::vector<RGBA> image(width * height);
+
+    long long samples = rtConfig.enableSuperSample ? std::max(rtConfig.samplesPerPixel, 1) : 1;
+    std::string name = "frame/" + QFileInfo(configPath).completeBaseName().toStdString();
+
+    results.push_back(measure(name, 1, (long long)width * height * samples, repeats, [&]() {
+        raytracer.render(image.data(), rtScene);
+    }));
+
+    return true;
+
+}
+
+//  ===== OUTPUT ======
+
+static void printCSV(std::ostream &out, const std::vector<BenchmarkResult> &results) {
+
+    out << "name,ops,seconds,ns_per_op,rays_per_sec" << std::endl;
+
+    for (const BenchmarkResult &result : results) {
+        double raysPerSecond = result.rays > 0 ? result.rays / result.seconds : 0.0;
+        out << result.name << ","
+            << result.ops << ","
+            << result.seconds << ","
+            << 1e9 * result.seconds / result.ops << ","
+            << raysPerSecond << std::endl;
+    }
+
+}
+
+static void printJSON(std::ostream &out, const std::vector<BenchmarkResult> &results) {
+
+    out << "[" << std::endl;
+
+    for (int index = 0; index < (int)results.size(); index++) {
+        const BenchmarkResult &result = results[index];
+        double raysPerSecond = result.rays > 0 ? result.rays / result.seconds : 0.0;
+        out << "  {\"name\": \"" << result.name << "\""
+            << ", \"ops\": " << result.ops
+            << ", \"seconds\": " << result.seconds
+            << ", \"ns_per_op\": " << 1e9 * result.seconds / result.ops
+            << ", \"rays_per_sec\": " << raysPerSecond
+            << "}" << (index + 1 < (int)results.size() ? "," : "") << std::endl;
+    }
+
+    out << "]" << std::endl;
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("configs", "Config files (.ini) whose scenes are rendered as full-frame benchmarks.", "[configs...]");
+
+    QCommandLineOption formatOption("format", "Output format, json or csv.", "format", "json");
+    QCommandLineOption repeatsOption("repeats", "Timed runs per benchmark; the fastest is reported.", "count",
+                                     QString::number(BENCHMARK_DEFAULT_REPEATS));
+    QCommandLineOption framesOnlyOption("frames-only", "Skip the microbenchmarks and only render the config files.");
+    QCommandLineOption outputOption("output", "Write the results to file instead of stdout, which scene loading also "
+                                    "logs to.", "file");
+    parser.addOption(formatOption);
+    parser.addOption(repeatsOption);
+    parser.addOption(framesOnlyOption);
+    parser.addOption(outputOption);
+    parser.process(a);
+
+    QString format = parser.value(formatOption).toLower();
+    if (format != "json" && format != "csv") {
+        std::cerr << "Unknown output format \"" << format.toStdString() << "\". Use json or csv." << std::endl;
+        a.exit(1);
+        return 1;
+    }
+
+    // Opened up front so a bad path fails before the benchmarks run.
+    std::ofstream outputFile;
+    if (parser.isSet(outputOption)) {
+        outputFile.open(parser.value(outputOption).toStdString());
+        if (!outputFile) {
+            std::cerr << "Error: could not open \"" << parser.value(outputOption).toStdString() << "\" for writing" << std::endl;
+            a.exit(1);
+            return 1;
+        }
+    }
+    std::ostream &out = outputFile.is_open() ? outputFile : std::cout;
+
+    int repeats = std::max(parser.value(repeatsOption).toInt(), 1);
+    std::vector<BenchmarkResult> results;
+
+    if (!parser.isSet(framesOnlyOption)) {
+
+        std::vector<Ray> rays = generateRays(BENCHMARK_RAY_COUNT);
+
+        benchmarkShape("Sphere", Sphere(), rays, repeats, results);
+        benchmarkShape("Cube", Cube(), rays, repeats, results);
+        benchmarkShape("Cylinder", Cylinder(), rays, repeats, results);
+        benchmarkShape("Cone", Cone(), rays, repeats, results);
+
+        benchmarkTexture(repeats, results);
+        benchmarkPhong(repeats, results);
+
+    }
+
+    bool success = true;
+    for (const QString &configPath : parser.positionalArguments()) {
+        success = benchmarkFrame(configPath, repeats, results) && success;
+    }
+
+    if (format == "csv") printCSV(out, results);
+    else printJSON(out, results);
+
+    a.exit(success ? 0 : 1);
+    return success ? 0 : 1;
+}
@@ -1,5 +1,6 @@
 #include <stdexcept>
 #include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
 #include "camera.h"
 #include <tuple>
 
@@ -63,6 +64,39 @@ Ray Camera::generateRay(float i, float j) const {
 
 }
 
+// Maps the unit square onto the unit disk with Shirley and Chiu's concentric mapping, which keeps strata compact.
+inline glm::vec2 concentricDisk(glm::vec2 sample) {
+
+    glm::vec2 offset = 2.0f * sample - 1.0f;
+    if (offset.x == 0.0f && offset.y == 0.0f) return glm::vec2(0.0f);
+
+    float radius, theta;
+    if (glm::abs(offset.x) > glm::abs(offset.y)) {
+        radius = offset.x;
+        theta = glm::quarter_pi<float>() * (offset.y / offset.x);
+    } else {
+        radius = offset.y;
+        theta = glm::half_pi<float>() - glm::quarter_pi<float>() * (offset.x / offset.y);
+    }
+
+    return radius * glm::vec2(glm::cos(theta), glm::sin(theta));
+
+}
+
+// Generates a thin lens ray in CAMERA SPACE.
+Ray Camera::generateRay(float i, float j, glm::vec2 lensSample) const {
+
+    Ray ray = generateRay(i, j);
+
+    // The pinhole direction reaches the plane in focus at focalLength / k times its length. Scaling the lens offset by
+    // k / focalLength instead keeps the direction on the image plane, where the ray differentials are measured.
+    ray.origin = glm::vec3(0.5f * aperture * concentricDisk(lensSample), 0.0f);
+    ray.direction -= ray.origin * (k / focalLength);
+
+    return ray;
+
+}
+
 glm::mat4 Camera::getViewMatrix() const {
     return viewMatrix;
 }
@@ -87,7 +121,7 @@ float Camera::getAperture() const {
     return aperture;
 }
 
-void Camera::calculateR(int spp) const {
+std::tuple<glm::vec3, glm::vec3> Camera::calculateR(int spp) const {
 
     float sWidth  = (static_cast<float>(imgWidth) * glm::ceil(glm::sqrt(static_cast<float>(spp))));
     float sHeight = (static_cast<float>(imgHeight) * glm::ceil(glm::sqrt(static_cast<float>(spp))));
@@ -95,7 +129,6 @@ void Camera::calculateR(int spp) const {
     float x = (2.0f * k * glm::tan(widthAngle / 2.0f)) / sWidth;
     float y = (2.0f * k * glm::tan(heightAngle / 2.0f)) / sHeight;
 
-    std::get<0>(r_bar) = glm::vec3(x, 0.0f, 0.0f);
-    std::get<1>(r_bar) = glm::vec3(0.0f, y, 0.0f);
+    return {glm::vec3(x, 0.0f, 0.0f), glm::vec3(0.0f, y, 0.0f)};
 
 }
@@ -2,6 +2,7 @@
 
 #include "utils/scenedata.h"
 #include <glm/glm.hpp>
+#include <tuple>
 
 // A class representing a virtual camera.
 
@@ -45,7 +46,6 @@ private:
 
 public:
 
-    mutable std::tuple<glm::vec3, glm::vec3> r_bar;
     glm::vec3 position;
 
     void init(const SceneCameraData& camera, int imgWidth, int imgHeight);
@@ -73,6 +73,15 @@ public:
     float getAperture() const;
 
     Ray generateRay(float i, float j) const;
-    void calculateR(int spp) const;
+
+    // Generates the ray through (i, j) in camera space as a thin lens sees it: the ray leaves the point of the lens
+    // picked by lensSample (in [0, 1)^2, mapped onto a disk aperture wide) and meets the pinhole ray focalLength in
+    // front of the camera.
+    Ray generateRay(float i, float j, glm::vec2 lensSample) const;
+
+
+    // Returns the camera space steps between neighbouring samples on the image plane, along x and y, with spp
+    // samples per pixel. Texture filtering measures ray differentials with them.
+    std::tuple<glm::vec3, glm::vec3> calculateR(int spp) const;
 
 };
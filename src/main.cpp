@@ -3,11 +3,16 @@
 #include <QImage>
 #include <QtCore>
 
+#include <algorithm>
 #include <iostream>
+#include "utils/batchrenderer.h"
+#include "utils/configreader.h"
+#include "utils/imagewriter.h"
 #include "utils/ini_utils.h"
 #include "utils/sceneparser.h"
 #include "raytracer/raytracer.h"
 #include "raytracer/raytracescene.h"
+#include "textures/texturecache.h"
 
 int main(int argc, char *argv[])
 {
@@ -15,17 +20,37 @@ int main(int argc, char *argv[])
 
     QCommandLineParser parser;
     parser.addHelpOption();
-    parser.addPositionalArgument("config", "Path of the config file.");
+    parser.addPositionalArgument("config", "Path of the config file, or several config files and wildcard patterns to render as a batch.");
+
+    QCommandLineOption manifestOption("manifest", "Also render the config files listed in <file>, one per line.", "file");
+    QCommandLineOption threadsOption("threads", "Total render threads of a batch (default: all cores).", "count", "0");
+    QCommandLineOption jobsOption("jobs", "Configs of a batch rendered at once (default: one per thread).", "count", "0");
+    parser.addOption(manifestOption);
+    parser.addOption(threadsOption);
+    parser.addOption(jobsOption);
     parser.process(a);
 
     auto positionalArgs = parser.positionalArguments();
-    if (positionalArgs.size() != 1) {
+    std::vector<std::string> configs = BatchRenderer::collectConfigs(positionalArgs, parser.value(manifestOption));
+
+    if (configs.empty()) {
         std::cerr << "Not enough arguments. Please provide a path to a config file (.ini) as a command-line argument." << std::endl;
         a.exit(1);
         return 1;
     }
 
-    QSettings settings( positionalArgs[0], QSettings::IniFormat );
+    // Batch Mode --
+    // Several configs render in this one process, sharing scenes and textures between them.
+    if (configs.size() > 1 || parser.isSet(manifestOption) || parser.isSet(threadsOption) || parser.isSet(jobsOption)) {
+
+        int failures = BatchRenderer::run(configs, parser.value(threadsOption).toInt(), parser.value(jobsOption).toInt());
+
+        a.exit(failures > 0 ? 1 : 0);
+        return failures > 0 ? 1 : 0;
+
+    }
+
+    QSettings settings( QString::fromStdString(configs.front()), QSettings::IniFormat );
     QString iScenePath = settings.value("IO/scene").toString();
     QString oImagePath = settings.value("IO/output").toString();
 
@@ -43,36 +68,17 @@ int main(int argc, char *argv[])
     int width = settings.value("Canvas/width").toInt();
     int height = settings.value("Canvas/height").toInt();
 
+    // HDR outputs (.pfm, .exr) keep the float colors of the render; anything else goes through QImage as 8-bit RGBA.
+    bool hdr = ImageWriter::isHDR(oImagePath);
+    std::vector<glm::vec4> hdrData(hdr ? width * height : 0);
+
     // Extracting data pointer from Qt's image API
-    QImage image = QImage(width, height, QImage::Format_RGBX8888);
+    QImage image = hdr ? QImage() : QImage(width, height, QImage::Format_RGBX8888);
     image.fill(Qt::black);
     RGBA *data = reinterpret_cast<RGBA *>(image.bits());
 
     // Setting up the raytracer
-    RayTracer::Config rtConfig{};
-    rtConfig.enableShadow        = settings.value("Feature/shadows").toBool();
-    rtConfig.enableReflection    = settings.value("Feature/reflect").toBool();
-    rtConfig.enableRefraction    = settings.value("Feature/refract").toBool();
-
-    rtConfig.enableTextureMap = settings.value("Feature/texture").toBool();
-
-    if (rtConfig.enableTextureMap)
-        rtConfig.textureFilterType = IniUtils::textureFilterTypeFromString(settings.value("Feature/texture-filter").toString());
-
-    rtConfig.enableParallelism   = settings.value("Feature/parallel").toBool();
-
-    rtConfig.enableSuperSample   = settings.value("Feature/super-sample").toBool();
-    if (settings.contains("Settings/samples-per-pixel"))
-        rtConfig.samplesPerPixel = settings.value("Settings/samples-per-pixel").toInt();
-    if (settings.contains("Settings/super-sampler-pattern"))
-        rtConfig.superSamplerPattern = IniUtils::superSamplerPatternFromString(settings.value("Settings/super-sampler-pattern").toString());
-
-    rtConfig.enableAcceleration  = settings.value("Feature/acceleration").toBool();
-    rtConfig.enableDepthOfField  = settings.value("Feature/depthoffield").toBool();
-    rtConfig.maxRecursiveDepth   = settings.value("Settings/maximum-recursive-depth").toInt();
-    rtConfig.onlyRenderNormals   = settings.value("Settings/only-render-normals").toBool();
-
-    rtConfig.enableMipMapping = settings.value("Feature/mipmapping").toBool();
+    RayTracer::Config rtConfig = ConfigReader::rayTracerConfig(settings);
 
     if (rtConfig.textureFilterType == TextureFilterType::Trilinear && !rtConfig.enableMipMapping) {
         std::cerr << "Error: Trilinear filtering requires mip-mapping." << std::endl;
@@ -82,21 +88,71 @@ int main(int argc, char *argv[])
 
     RayTracer raytracer{ rtConfig };
 
-    RayTraceScene rtScene{ width, height, metaData };
+    // Built textures are kept on disk between runs when a cache directory is given.
+    TextureCache::setDirectory(settings.value("IO/texture-cache").toString().toStdString());
+
+    RayTraceScene rtScene{ width, height, metaData, rtConfig.threadCount };
+
+    // Saving the image
+    auto saveImage = [&](const QString &path) {
+        bool saved;
+        if (hdr) {
+            saved = ImageWriter::write(path, hdrData.data(), width, height);
+        } else {
+            saved = image.save(path);
+            if (!saved) {
+                saved = image.save(path, "PNG");
+            }
+        }
+        if (saved) {
+            std::cout << "Saved rendered image to \"" << path.toStdString() << "\"" << std::endl;
+        } else {
+            std::cerr << "Error: failed to save image to \"" << path.toStdString() << "\"" << std::endl;
+        }
+    };
 
     // Note that we're passing `data` as a pointer (to its first element)
     // Recall from Lab 1 that you can access its elements like this: `data[i]`
-    raytracer.render(data, rtScene);
+    if (rtScene.frameCount() > 1) {
+
+        // Animated scenes are posed at each frame in turn, and every frame is saved to its own file.
+        int firstFrame, lastFrame;
+        ConfigReader::frameRange(settings, rtScene.frameCount(), firstFrame, lastFrame);
+
+        for (int frame = firstFrame; frame <= lastFrame; frame++) {
+            rtScene.setFrame(frame);
+            if (hdr) raytracer.render(hdrData.data(), rtScene);
+            else raytracer.render(data, rtScene);
+            saveImage(ConfigReader::framePath(oImagePath, frame));
+        }
+
+    } else if (rtConfig.enableProgressive) {
+
+        // Overwrites the output after every pass, so the latest preview is always on disk.
+        auto onPass = [&](int samplesPerPixel) {
+            std::cout << "Finished pass at " << samplesPerPixel << " samples per pixel" << std::endl;
+            saveImage(oImagePath);
+        };
+
+        if (hdr) raytracer.renderProgressive(hdrData.data(), rtScene, onPass);
+        else raytracer.renderProgressive(data, rtScene, onPass);
 
-    // Saving the image
-    success = image.save(oImagePath);
-    if (!success) {
-        success = image.save(oImagePath, "PNG");
-    }
-    if (success) {
-        std::cout << "Saved rendered image to \"" << oImagePath.toStdString() << "\"" << std::endl;
     } else {
-        std::cerr << "Error: failed to save image to \"" << oImagePath.toStdString() << "\"" << std::endl;
+
+        if (hdr) raytracer.render(hdrData.data(), rtScene);
+        else raytracer.render(data, rtScene);
+        saveImage(oImagePath);
+
+    }
+
+    if (rtConfig.enableWavefront && rtConfig.enableRayBinning) {
+
+        RayTracer::BinningStats stats = raytracer.binningStats();
+        double packets = (double)std::max<std::uint64_t>(stats.packets, 1);
+
+        std::cout << "Binned " << stats.rays << " secondary rays: " << stats.binsBefore / packets << " bins per packet of "
+                  << RAY_PACKET_WIDTH << " as spawned, " << stats.binsAfter / packets << " sorted" << std::endl;
+
     }
 
     a.exit();
@@ -0,0 +1,223 @@
+#include "bvh.h"
+#include <algorithm>
+
+void BVH::build(const std::vector<AABB> &primitiveBounds) {
+
+    m_nodes.clear();
+    m_primitiveIndices.clear();
+    m_parents.clear();
+    m_leaves.clear();
+    m_weightedArea = 0.0;
+    m_builtCost = 0.0f;
+
+    if (primitiveBounds.empty()) return;
+
+    std::vector<BuildEntry> entries;
+    entries.reserve(primitiveBounds.size());
+
+    for (int i = 0; i < (int)primitiveBounds.size(); i++) {
+        entries.push_back(BuildEntry{primitiveBounds[i], primitiveBounds[i].centroid(), i});
+    }
+
+    m_nodes.reserve(2 * entries.size());
+    m_primitiveIndices.reserve(entries.size());
+
+    buildRecursive(entries, 0, (int)entries.size(), 0);
+
+    for (const Node &node : m_nodes) m_weightedArea += (double)weight(node) * node.bounds.surfaceArea();
+    m_builtCost = cost();
+
+}
+
+bool BVH::refit(const std::vector<AABB> &primitiveBounds, const std::vector<int> &changed) {
+
+    if (m_nodes.empty()) return false;
+
+    if (m_parents.empty()) {
+
+        m_parents.assign(m_nodes.size(), -1);
+        m_leaves.resize(primitiveBounds.size());
+
+        for (int index = 0; index < (int)m_nodes.size(); index++) {
+
+            const Node &node = m_nodes[index];
+
+            if (node.count > 0) {
+                for (int i = 0; i < node.count; i++) m_leaves[m_primitiveIndices[node.offset + i]] = index;
+            } else {
+                m_parents[index + 1] = index;
+                m_parents[node.offset] = index;
+            }
+
+        }
+
+    }
+
+    // Walk up from the leaf of every changed primitive, stopping at the first node whose bounds come out the same:
+    // everything above it is already up to date.
+    for (int primitive : changed) {
+
+        for (int index = m_leaves[primitive]; index >= 0; index = m_parents[index]) {
+
+            Node &node = m_nodes[index];
+            AABB bounds;
+
+            if (node.count > 0) {
+                for (int i = 0; i < node.count; i++) bounds.expand(primitiveBounds[m_primitiveIndices[node.offset + i]]);
+            } else {
+                bounds.expand(m_nodes[index + 1].bounds);
+                bounds.expand(m_nodes[node.offset].bounds);
+            }
+
+            if (bounds.min == node.bounds.min && bounds.max == node.bounds.max) break;
+
+            m_weightedArea += (double)weight(node) * (bounds.surfaceArea() - node.bounds.surfaceArea());
+            node.bounds = bounds;
+
+        }
+
+    }
+
+    if (cost() <= BVH_REBUILD_COST_RATIO * m_builtCost) return false;
+
+    build(primitiveBounds);
+    return true;
+
+}
+
+float BVH::cost() const {
+
+    float rootArea = m_nodes.empty() ? 0.0f : m_nodes[0].bounds.surfaceArea();
+    if (rootArea <= 0.0f) return 0.0f;
+
+    return (float)(m_weightedArea / rootArea);
+
+}
+
+// Interior nodes cost one box test, leaves one test per primitive.
+float BVH::weight(const Node &node) {
+    return (node.count > 0) ? (float)node.count : 1.0f;
+}
+
+// Builds the subtree over entries[begin, end) and returns the index of its root node.
+// Children are laid out depth-first: the first child directly follows its parent.
+int BVH::buildRecursive(std::vector<BuildEntry> &entries, int begin, int end, int depth) {
+
+    int nodeIndex = (int)m_nodes.size();
+    m_nodes.push_back(Node{});
+
+    AABB bounds, centroidBounds;
+    for (int i = begin; i < end; i++) {
+        bounds.expand(entries[i].bounds);
+        centroidBounds.expand(entries[i].centroid);
+    }
+
+    int count = end - begin;
+
+    auto makeLeaf = [&]() {
+        m_nodes[nodeIndex] = Node{bounds, (int)m_primitiveIndices.size(), count, 0};
+        for (int i = begin; i < end; i++) m_primitiveIndices.push_back(entries[i].index);
+        return nodeIndex;
+    };
+
+    if (count <= BVH_MAX_LEAF_SIZE) return makeLeaf();
+
+    int axis = centroidBounds.largestAxis();
+    float axisMin = centroidBounds.min[axis];
+    float axisExtent = centroidBounds.max[axis] - axisMin;
+
+    int mid;
+
+    if (axisExtent <= 0.0f) {
+
+        // Every centroid coincides, so split down the middle.
+        mid = begin + count / 2;
+
+    } else if (depth >= BVH_SAH_MAX_DEPTH) {
+
+        // Object Median --
+        // Lopsided SAH splits of very large inputs (e.g. scanned meshes) could outgrow the traversal stack.
+        mid = begin + count / 2;
+        std::nth_element(entries.begin() + begin, entries.begin() + mid, entries.begin() + end,
+                         [&](const BuildEntry &a, const BuildEntry &b) { return a.centroid[axis] < b.centroid[axis]; });
+
+    } else {
+
+        // Binned SAH --
+        struct Bin {
+            AABB bounds;
+            int count = 0;
+        };
+        Bin bins[BVH_SAH_BINS];
+
+        auto binIndex = [&](const BuildEntry &entry) {
+            int b = (int)(BVH_SAH_BINS * (entry.centroid[axis] - axisMin) / axisExtent);
+            return glm::clamp(b, 0, BVH_SAH_BINS - 1);
+        };
+
+        for (int i = begin; i < end; i++) {
+            Bin &bin = bins[binIndex(entries[i])];
+            bin.bounds.expand(entries[i].bounds);
+            bin.count++;
+        }
+
+        // Sweep from the right to collect the area and count of every suffix of bins.
+        float rightArea[BVH_SAH_BINS];
+        int rightCount[BVH_SAH_BINS];
+        AABB accumulated;
+        int accumulatedCount = 0;
+
+        for (int b = BVH_SAH_BINS - 1; b > 0; b--) {
+            accumulated.expand(bins[b].bounds);
+            accumulatedCount += bins[b].count;
+            rightArea[b] = accumulated.surfaceArea();
+            rightCount[b] = accumulatedCount;
+        }
+
+        float bestCost = INFINITY;
+        int bestSplit = -1;
+        accumulated = AABB();
+        accumulatedCount = 0;
+
+        for (int b = 0; b < BVH_SAH_BINS - 1; b++) {
+
+            accumulated.expand(bins[b].bounds);
+            accumulatedCount += bins[b].count;
+
+            if (accumulatedCount == 0 || rightCount[b + 1] == 0) continue;
+
+            float cost = accumulated.surfaceArea() * accumulatedCount + rightArea[b + 1] * rightCount[b + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestSplit = b;
+            }
+
+        }
+
+        // Splitting has to beat intersecting every primitive in one leaf.
+        float leafCost = bounds.surfaceArea() * count;
+        if (bestSplit < 0 || (bestCost >= leafCost && count <= 2 * BVH_MAX_LEAF_SIZE)) return makeLeaf();
+
+        auto middle = std::partition(entries.begin() + begin, entries.begin() + end,
+                                     [&](const BuildEntry &entry) { return binIndex(entry) <= bestSplit; });
+        mid = (int)(middle - entries.begin());
+
+        if (mid == begin || mid == end) mid = begin + count / 2;
+
+    }
+
+    buildRecursive(entries, begin, mid, depth + 1);
+    int secondChild = buildRecursive(entries, mid, end, depth + 1);
+
+    m_nodes[nodeIndex] = Node{bounds, secondChild, 0, axis};
+    return nodeIndex;
+
+}
+
+bool BVH::isEmpty() const {
+    return m_nodes.empty();
+}
+
+const std::vector<BVH::Node> &BVH::nodes() const {
+    return m_nodes;
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "camera/camera.h"
+#include "shapes/packet.h"
+#include "utils/aabb.h"
+
+#define BVH_MAX_LEAF_SIZE 4
+#define BVH_SAH_BINS 12
+#define BVH_SAH_MAX_DEPTH 48 // Deeper nodes split at the object median, which bounds the tree depth
+#define BVH_STACK_SIZE 96    // Enough for BVH_SAH_MAX_DEPTH plus median splits of 2^32 primitives
+#define BVH_REBUILD_COST_RATIO 1.5f // Refits that raise the SAH cost past this multiple of the built tree's rebuild it
+
+// A bounding volume hierarchy over a list of primitive bounding boxes, built with the binned
+// surface area heuristic. The tree only stores primitive indices; callers supply the actual
+// intersection test through the traversal callbacks below.
+
+class BVH
+{
+public:
+    struct Node {
+        AABB bounds;
+        int offset; // Leaf: first entry in primitiveIndices. Interior: index of the second child.
+        int count;  // Number of primitives in a leaf, 0 for interior nodes.
+        int axis;   // Split axis of an interior node.
+    };
+
+    // Builds the hierarchy. Primitive i of every callback refers to primitiveBounds[i].
+    void build(const std::vector<AABB> &primitiveBounds);
+
+    // Updates the bounds of the changed primitives and of the nodes above them, keeping the tree as built, in
+    // O(changed * depth). primitiveBounds holds the same primitives, in the same order, as the last build.
+    // Refitting never splits the tree differently, so once the moves have raised its SAH cost by
+    // BVH_REBUILD_COST_RATIO the tree is built again instead.
+    // @return True if the tree was rebuilt.
+    bool refit(const std::vector<AABB> &primitiveBounds, const std::vector<int> &changed);
+
+    // The SAH cost of the tree: the expected number of nodes visited and primitives tested by a ray that
+    // hits the root's bounds.
+    float cost() const;
+
+    bool isEmpty() const;
+    const std::vector<Node> &nodes() const;
+
+    // Visits the primitives a ray may hit, nearest subtree first, skipping every node entered
+    // beyond tMax. visit(index) may shrink tMax (it is read back after each leaf).
+    template <typename Visitor>
+    void closestHit(const Ray &ray, float &tMax, Visitor &&visit) const;
+
+    // Packet version of closestHit. A node is entered while any active lane overlaps it; the
+    // children are ordered by the first lane's direction since the rays are expected to be coherent.
+    template <typename Visitor>
+    void closestHit(const RayPacket &packet, PacketFloat &tMax, Visitor &&visit) const;
+
+    // Returns true as soon as test(index) reports a blocker for a ray segment [0, tMax].
+    template <typename Test>
+    bool anyHit(const Ray &ray, float tMax, Test &&test) const;
+
+private:
+
+    struct BuildEntry {
+        AABB bounds;
+        glm::vec3 centroid;
+        int index;
+    };
+
+    std::vector<Node> m_nodes;
+    std::vector<int> m_primitiveIndices;
+
+    // Filled by the first refit, so trees that never move (e.g. of meshes) do not pay for them.
+    std::vector<int> m_parents; // Parent of every node, -1 for the root
+    std::vector<int> m_leaves;  // Leaf holding every primitive
+
+    double m_weightedArea = 0.0; // Sum of node areas, leaves weighted by their primitive count
+    float m_builtCost = 0.0f;
+
+    static PacketMask intersectPacket(const AABB &bounds, const RayPacket &packet, const PacketFloat invDirection[3],
+                                      const PacketFloat &tMax);
+
+    int buildRecursive(std::vector<BuildEntry> &entries, int begin, int end, int depth);
+
+    static float weight(const Node &node);
+};
+
+template <typename Visitor>
+void BVH::closestHit(const Ray &ray, float &tMax, Visitor &&visit) const {
+
+    if (m_nodes.empty()) return;
+
+    glm::vec3 invDirection = 1.0f / ray.direction;
+    bool negative[3] = {invDirection.x < 0, invDirection.y < 0, invDirection.z < 0};
+
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    int current = 0;
+
+    while (true) {
+
+        const Node &node = m_nodes[current];
+        float tNear;
+
+        if (node.bounds.intersect(ray.origin, invDirection, tMax, tNear)) {
+
+            if (node.count > 0) {
+
+                for (int i = 0; i < node.count; i++) {
+                    visit(m_primitiveIndices[node.offset + i]);
+                }
+
+            } else {
+
+                // Descend into the child on the ray's side of the split first.
+                if (negative[node.axis]) {
+                    stack[stackSize++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stackSize++] = node.offset;
+                    current = current + 1;
+                }
+                continue;
+
+            }
+
+        }
+
+        if (stackSize == 0) break;
+        current = stack[--stackSize];
+
+    }
+
+}
+
+inline PacketMask BVH::intersectPacket(const AABB &bounds, const RayPacket &packet, const PacketFloat invDirection[3],
+                                      const PacketFloat &tMax) {
+
+    const PacketFloat *origin[3] = {&packet.originX, &packet.originY, &packet.originZ};
+
+    PacketFloat enter(0.0f);
+    PacketFloat exit = tMax;
+
+    for (int axis = 0; axis < 3; axis++) {
+
+        PacketFloat t0 = (PacketFloat(bounds.min[axis]) - *origin[axis]) * invDirection[axis];
+        PacketFloat t1 = (PacketFloat(bounds.max[axis]) - *origin[axis]) * invDirection[axis];
+
+        // NaN slabs (origin on a plane the ray runs parallel to) fall through to the second operand.
+        enter = max(min(t0, t1), enter);
+        exit = min(max(t0, t1), exit);
+
+    }
+
+    return packet.active & (enter <= exit);
+
+}
+
+template <typename Visitor>
+void BVH::closestHit(const RayPacket &packet, PacketFloat &tMax, Visitor &&visit) const {
+
+    if (m_nodes.empty()) return;
+
+    PacketFloat invDirection[3] = {PacketFloat(1.0f) / packet.directionX,
+                                   PacketFloat(1.0f) / packet.directionY,
+                                   PacketFloat(1.0f) / packet.directionZ};
+
+    bool negative[3];
+    for (int axis = 0; axis < 3; axis++) {
+        float lanes[RAY_PACKET_WIDTH];
+        invDirection[axis].store(lanes);
+        negative[axis] = lanes[0] < 0;
+    }
+
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    int current = 0;
+
+    while (true) {
+
+        const Node &node = m_nodes[current];
+
+        if (intersectPacket(node.bounds, packet, invDirection, tMax).any()) {
+
+            if (node.count > 0) {
+
+                for (int i = 0; i < node.count; i++) {
+                    visit(m_primitiveIndices[node.offset + i]);
+                }
+
+            } else {
+
+                if (negative[node.axis]) {
+                    stack[stackSize++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stackSize++] = node.offset;
+                    current = current + 1;
+                }
+                continue;
+
+            }
+
+        }
+
+        if (stackSize == 0) break;
+        current = stack[--stackSize];
+
+    }
+
+}
+
+template <typename Test>
+bool BVH::anyHit(const Ray &ray, float tMax, Test &&test) const {
+
+    if (m_nodes.empty()) return false;
+
+    glm::vec3 invDirection = 1.0f / ray.direction;
+
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    int current = 0;
+
+    while (true) {
+
+        const Node &node = m_nodes[current];
+        float tNear;
+
+        if (node.bounds.intersect(ray.origin, invDirection, tMax, tNear)) {
+
+            if (node.count > 0) {
+
+                for (int i = 0; i < node.count; i++) {
+                    if (test(m_primitiveIndices[node.offset + i])) return true;
+                }
+
+            } else {
+
+                stack[stackSize++] = node.offset;
+                current = current + 1;
+                continue;
+
+            }
+
+        }
+
+        if (stackSize == 0) break;
+        current = stack[--stackSize];
+
+    }
+
+    return false;
+
+}
@@ -0,0 +1,199 @@
+#include "instancearrays.h"
+
+void InstanceArrays::addTemplate(const std::vector<std::shared_ptr<Shape>> &shapes, int firstShape) {
+
+    m_templates.emplace_back();
+    Template &added = m_templates.back();
+
+    added.shapeArrays.build(shapes);
+    added.firstShape = firstShape;
+
+    std::vector<AABB> shapeBounds;
+    for (int index = 0; index < (int)shapes.size(); index++) {
+        shapeBounds.push_back(added.shapeArrays.worldBounds(index));
+        added.bounds.expand(shapeBounds.back());
+    }
+    added.bvh.build(shapeBounds);
+
+}
+
+void InstanceArrays::addInstance(int templateIndex, const glm::mat4 &ctm) {
+
+    m_templateIndices.push_back(templateIndex);
+    m_ctms.emplace_back();
+    m_inverseCTMs.emplace_back();
+    m_bounds.emplace_back();
+
+    setTransform((int)m_ctms.size() - 1, ctm);
+
+}
+
+void InstanceArrays::setTransform(int instance, const glm::mat4 &ctm) {
+
+    m_ctms[instance] = ctm;
+    m_inverseCTMs[instance] = glm::inverse(ctm);
+    m_bounds[instance] = m_templates[m_templateIndices[instance]].bounds.transformed(ctm);
+
+}
+
+int InstanceArrays::size() const {
+    return (int)m_ctms.size();
+}
+
+const glm::mat4 &InstanceArrays::ctm(int instance) const {
+    return m_ctms[instance];
+}
+
+const glm::mat4 &InstanceArrays::inverseCTM(int instance) const {
+    return m_inverseCTMs[instance];
+}
+
+const AABB &InstanceArrays::worldBounds(int instance) const {
+    return m_bounds[instance];
+}
+
+Ray InstanceArrays::toTemplate(int instance, const Ray &ray, float &scale) const {
+
+    const glm::mat4 &inverseCTM = m_inverseCTMs[instance];
+
+    glm::vec3 direction = glm::vec3(inverseCTM * glm::vec4(ray.direction, 0.0f));
+    scale = glm::length(direction);
+
+    return Ray {glm::vec3(inverseCTM * glm::vec4(ray.origin, 1.0f)), direction / scale};
+
+}
+
+void InstanceArrays::intersectInstance(int instance, const Ray &ray, ShapeHit &hit, bool accelerate) const {
+
+    const Template &shapes = m_templates[m_templateIndices[instance]];
+
+    float scale;
+    Ray local = toTemplate(instance, ray, scale);
+
+    ShapeHit localHit;
+    localHit.t = hit.t * scale;
+
+    if (accelerate) {
+        shapes.bvh.closestHit(local, localHit.t, [&](int index) { shapes.shapeArrays.intersect(index, local, localHit); });
+    } else {
+        shapes.shapeArrays.intersectAll(local, localHit);
+    }
+
+    if (localHit.shapeIndex < 0) return;
+
+    // Scaling back can round past the hit already found, so it is compared again in world space.
+    float t = localHit.t / scale;
+    if (!(t < hit.t)) return;
+
+    hit = localHit;
+    hit.t = t;
+    hit.shapeIndex += shapes.firstShape;
+    hit.instance = instance;
+
+}
+
+void InstanceArrays::intersectInstance(int instance, const RayPacket &packet, PacketHit &hit, bool accelerate) const {
+
+    const Template &shapes = m_templates[m_templateIndices[instance]];
+
+    RayPacket local = packet.transformed(m_inverseCTMs[instance]);
+
+    PacketFloat scale = sqrt(local.directionX * local.directionX + local.directionY * local.directionY +
+                             local.directionZ * local.directionZ);
+    local.directionX = local.directionX / scale;
+    local.directionY = local.directionY / scale;
+    local.directionZ = local.directionZ / scale;
+
+    PacketHit localHit;
+    localHit.t = hit.t * scale;
+
+    float lanes[2][RAY_PACKET_WIDTH];
+    localHit.t.store(lanes[0]);
+    scale.store(lanes[1]);
+
+    for (int lane = 0; lane < RAY_PACKET_WIDTH; lane++) localHit.lanes[lane].t = lanes[0][lane];
+
+    if (accelerate) {
+        shapes.bvh.closestHit(local, localHit.t, [&](int index) { shapes.shapeArrays.intersect(index, local, localHit); });
+    } else {
+        shapes.shapeArrays.intersectAll(local, localHit);
+    }
+
+    for (int lane = 0; lane < RAY_PACKET_WIDTH; lane++) {
+
+        const ShapeHit &laneHit = localHit.lanes[lane];
+        if (!packet.active.lane(lane) || laneHit.shapeIndex < 0) continue;
+
+        float t = laneHit.t / lanes[1][lane];
+        if (!(t < hit.lanes[lane].t)) continue;
+
+        hit.lanes[lane] = laneHit;
+        hit.lanes[lane].t = t;
+        hit.lanes[lane].shapeIndex += shapes.firstShape;
+        hit.lanes[lane].instance = instance;
+
+    }
+
+    for (int lane = 0; lane < RAY_PACKET_WIDTH; lane++) lanes[0][lane] = hit.lanes[lane].t;
+    hit.t = PacketFloat::load(lanes[0]);
+
+}
+
+void InstanceArrays::intersect(int instance, const Ray &ray, ShapeHit &hit) const {
+    intersectInstance(instance, ray, hit, true);
+}
+
+void InstanceArrays::intersect(int instance, const RayPacket &packet, PacketHit &hit) const {
+    intersectInstance(instance, packet, hit, true);
+}
+
+void InstanceArrays::intersectAll(const Ray &ray, ShapeHit &hit) const {
+
+    glm::vec3 invDirection = 1.0f / ray.direction;
+
+    for (int instance = 0; instance < size(); instance++) {
+        float tNear;
+        if (m_bounds[instance].intersect(ray.origin, invDirection, hit.t, tNear)) intersectInstance(instance, ray, hit, false);
+    }
+
+}
+
+void InstanceArrays::intersectAll(const RayPacket &packet, PacketHit &hit) const {
+
+    for (int instance = 0; instance < size(); instance++) intersectInstance(instance, packet, hit, false);
+
+}
+
+bool InstanceArrays::occluded(int instance, const Ray &ray, float tMax) const {
+
+    const Template &shapes = m_templates[m_templateIndices[instance]];
+
+    float scale;
+    Ray local = toTemplate(instance, ray, scale);
+    float localMax = tMax * scale;
+
+    return shapes.bvh.anyHit(local, localMax, [&](int index) { return shapes.shapeArrays.occluded(index, local, localMax); });
+
+}
+
+int InstanceArrays::findOccluder(const Ray &ray, float tMax, int skipInstance) const {
+
+    glm::vec3 invDirection = 1.0f / ray.direction;
+
+    for (int instance = 0; instance < size(); instance++) {
+
+        float tNear;
+        if (instance == skipInstance || !m_bounds[instance].intersect(ray.origin, invDirection, tMax, tNear)) continue;
+
+        const Template &shapes = m_templates[m_templateIndices[instance]];
+
+        float scale;
+        Ray local = toTemplate(instance, ray, scale);
+
+        if (shapes.shapeArrays.findOccluder(local, tMax * scale) >= 0) return instance;
+
+    }
+
+    return -1;
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+#include "bvh.h"
+#include "shapearrays.h"
+
+// Instances of the scene's templateGroups: the bottom level of a two-level acceleration structure.
+// A template keeps its shapes once, with their ShapeArrays and BVH in the template's own space. An instance
+// only stores a transform and its world bounds, which the scene's BVH (the top level) is built over, so a
+// template placed N times costs N transforms instead of N copies of its shapes.
+// Rays are moved into template space and renormalized there, so the template's queries keep their unit
+// direction; distances are scaled on the way in and back to world space on the way out.
+
+class InstanceArrays
+{
+public:
+    // Adds a template over shapes. Hits on shapes[i] report firstShape + i as ShapeHit::shapeIndex.
+    void addTemplate(const std::vector<std::shared_ptr<Shape>> &shapes, int firstShape);
+
+    // Places template templateIndex with ctm, from the template's space to world space.
+    void addInstance(int templateIndex, const glm::mat4 &ctm);
+
+    // Moves an instance; its world bounds follow.
+    void setTransform(int instance, const glm::mat4 &ctm);
+
+    int size() const;
+    const glm::mat4 &ctm(int instance) const;
+    const glm::mat4 &inverseCTM(int instance) const;
+    const AABB &worldBounds(int instance) const;
+
+    // The queries of ShapeArrays, for one instance (through its template's BVH) or for every instance (testing
+    // each template shape in turn). Hits set ShapeHit::instance; findOccluder returns an instance, not a shape.
+    void intersect(int instance, const Ray &ray, ShapeHit &hit) const;
+    void intersect(int instance, const RayPacket &packet, PacketHit &hit) const;
+    void intersectAll(const Ray &ray, ShapeHit &hit) const;
+    void intersectAll(const RayPacket &packet, PacketHit &hit) const;
+    bool occluded(int instance, const Ray &ray, float tMax) const;
+    int findOccluder(const Ray &ray, float tMax, int skipInstance = -1) const;
+
+private:
+
+    struct Template {
+        ShapeArrays shapeArrays;
+        BVH bvh;
+        AABB bounds; // In the template's space
+        int firstShape;
+    };
+
+    std::vector<Template> m_templates;
+
+    std::vector<int> m_templateIndices;
+    std::vector<glm::mat4> m_ctms;
+    std::vector<glm::mat4> m_inverseCTMs;
+    std::vector<AABB> m_bounds;
+
+    // The ray in the template space of instance, with a unit direction. Distances there are scale times longer.
+    Ray toTemplate(int instance, const Ray &ray, float &scale) const;
+
+    void intersectInstance(int instance, const Ray &ray, ShapeHit &hit, bool accelerate) const;
+    void intersectInstance(int instance, const RayPacket &packet, PacketHit &hit, bool accelerate) const;
+};
@@ -0,0 +1,81 @@
+#include "raybinning.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+// Spreads the low 10 bits of value out to every third bit.
+std::uint32_t spreadBits(std::uint32_t value) {
+
+    value &= 0x3ff;
+    value = (value | (value << 16)) & 0x030000ff;
+    value = (value | (value << 8)) & 0x0300f00f;
+    value = (value | (value << 4)) & 0x030c30c3;
+    value = (value | (value << 2)) & 0x09249249;
+
+    return value;
+
+}
+
+} // namespace
+
+std::uint32_t RayBinning::bin(const Ray &ray, const AABB &bounds) {
+
+    const int cells = 1 << RAY_BINNING_GRID_BITS;
+
+    glm::vec3 extent = glm::max(bounds.max - bounds.min, glm::vec3(1e-6f));
+    glm::ivec3 cell = glm::clamp(glm::ivec3((ray.origin - bounds.min) / extent * (float)cells), 0, cells - 1);
+
+    std::uint32_t octant = (ray.direction.x < 0.0f ? 1u : 0u) |
+                           (ray.direction.y < 0.0f ? 2u : 0u) |
+                           (ray.direction.z < 0.0f ? 4u : 0u);
+
+    std::uint32_t morton = spreadBits(cell.x) | (spreadBits(cell.y) << 1) | (spreadBits(cell.z) << 2);
+
+    return (octant << (3 * RAY_BINNING_GRID_BITS)) | morton;
+
+}
+
+void RayBinning::sortByBin(const std::vector<std::uint32_t> &bins, std::vector<int> &order) {
+
+    // Radix Sort --
+    // Bins have at most 16 bits, so two stable counting passes over 8 bits each sort them in O(rays).
+    static_assert(3 + 3 * RAY_BINNING_GRID_BITS <= 16, "Bins must fit the two passes of sortByBin");
+
+    int count = (int)bins.size();
+
+    order.resize(count);
+    std::iota(order.begin(), order.end(), 0);
+
+    std::vector<int> sorted(count);
+
+    for (int shift = 0; shift < 16; shift += 8) {
+
+        int offsets[257] = {};
+        for (int index : order) offsets[((bins[index] >> shift) & 0xff) + 1]++;
+        for (int digit = 0; digit < 256; digit++) offsets[digit + 1] += offsets[digit];
+
+        for (int index : order) sorted[offsets[(bins[index] >> shift) & 0xff]++] = index;
+        order.swap(sorted);
+
+    }
+
+}
+
+int RayBinning::packetBins(const std::uint32_t *bins, int count, int packetWidth) {
+
+    int distinct = 0;
+
+    for (int first = 0; first < count; first += packetWidth) {
+
+        int last = std::min(first + packetWidth, count);
+
+        for (int k = first; k < last; k++) {
+            if (std::find(bins + first, bins + k, bins[k]) == bins + k) distinct++;
+        }
+
+    }
+
+    return distinct;
+
+}
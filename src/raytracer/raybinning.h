@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "camera/camera.h"
+#include "utils/aabb.h"
+
+#define RAY_BINNING_GRID_BITS 4 // The scene's bounds are split into 2^this origin cells per axis
+
+// Coherence binning of secondary rays. A ray's bin is the octant of its direction and the cell of a grid over the
+// scene's bounds its origin lies in. Sorting a queue by bin puts rays that start close together and head the same
+// way next to each other, so a packet of them walks the same BVH nodes and touches the same shapes and textures.
+// Bins order by octant first, then by cell along a Morton curve, so neighbouring cells stay close in the queue.
+namespace RayBinning {
+    std::uint32_t bin(const Ray &ray, const AABB &bounds);
+
+    // Fills order with the indices of bins sorted by bin, keeping indices of one bin in their order.
+    void sortByBin(const std::vector<std::uint32_t> &bins, std::vector<int> &order);
+
+    // The number of distinct bins in each run of packetWidth consecutive bins, summed over the runs. The fewer, the
+    // more coherent the packets traced from them.
+    int packetBins(const std::uint32_t *bins, int count, int packetWidth);
+} // namespace RayBinning
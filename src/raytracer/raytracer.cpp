@@ -1,17 +1,21 @@
 #include "raytracer.h"
+#include "raybinning.h"
 #include "raytracescene.h"
 #include "shapes/shape.h"
 #include "textures/texture.h"
-#include <random>
-
-std::random_device rd;
-std::mt19937 gen(rd());
-std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+#include "tilescheduler.h"
+#include <glm/gtx/component_wise.hpp>
 
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <numeric>
 
 RayTracer::RayTracer(Config config) :
-    m_config(config)
+    m_config(config),
+    m_sampler(config.seed)
 {}
 
 //                                                      ===== HELPER FUNCTIONS ======
@@ -23,69 +27,152 @@ inline int pointToIndex(int i, int j, int width) {
 
 }
 
-// Change vec4 of floats to RGBA value.
-inline RGBA toRGBA(const glm::vec4 &illumination) {
+// Compresses a linear color into [0, 1] (before the final clamp).
+inline glm::vec3 toneMap(glm::vec3 color, ToneMapOperator op) {
 
-    uint8_t r = (uint8_t)(255.0f * glm::min(glm::max(illumination[0], 0.0f), 1.0f));
-    uint8_t g = (uint8_t)(255.0f * glm::min(glm::max(illumination[1], 0.0f), 1.0f));
-    uint8_t b = (uint8_t)(255.0f * glm::min(glm::max(illumination[2], 0.0f), 1.0f));
+    switch (op) {
 
-    return RGBA{r, g, b, 255};
+    case ToneMapOperator::Reinhard:
+        return color / (1.0f + color);
+
+    case ToneMapOperator::ACES:
+        // Narkowicz's fit of the ACES filmic curve.
+        color = glm::max(color, 0.0f);
+        return (color * (2.51f * color + 0.03f)) / (color * (2.43f * color + 0.59f) + 0.14f);
+
+    default:
+        return color;
+
+    }
 
 }
 
-// Returns true if shadow ray does not intersect with anything before reaching light -- false otherwise.
-// Should only be used by phong().
-bool traceShadowRay(glm::vec3 position,
-                    const RayTraceScene& scene,
-                    const SceneLightData &light,
-                    glm::vec3 normal) {
+// Moves a camera space ray from Camera::generateRay to world space, normalizing its direction.
+inline Ray cameraRay(const Camera &camera, Ray ray) {
+
+    glm::vec4 originWorld = camera.getInverseViewMatrix() * glm::vec4(ray.origin, 1.0f);
+    glm::vec4 directionWorld = camera.getInverseViewMatrix() * glm::vec4(ray.direction, 0.0f);
+
+    ray.origin    = glm::vec3(originWorld);
+    ray.direction = glm::normalize(glm::vec3(directionWorld));
+    ray.unnormalizedDirection = glm::vec3(directionWorld);
+
+    return ray;
+
+}
+
+// Folds the bits of a ray into a key for the sampler, so decisions about a ray depend on the ray alone and
+// not on the order (or the mode) in which rays are traced.
+inline std::uint32_t rayKey(const Ray &ray) {
+
+    const float values[6] = {ray.origin.x, ray.origin.y, ray.origin.z, ray.direction.x, ray.direction.y, ray.direction.z};
+
+    std::uint32_t key = 2166136261u;
+    for (float value : values) key = (key ^ std::bit_cast<std::uint32_t>(value)) * 16777619u;
+
+    return key;
+
+}
+
+// The shape that blocked the last shadow ray towards each light, kept per render thread.
+// Neighbouring shadow rays are usually blocked by the same shape, so it is tested first.
+thread_local std::vector<int> lastOccluder;
+
+// Builds the ray from position towards light. Blockers only count up to tMax.
+Ray shadowRayTowards(glm::vec3 position,
+                     const SceneLightData &light,
+                     glm::vec3 normal,
+                     float &tMax) {
 
     Ray shadowRay;
     shadowRay.origin = position + 0.001f * normal;
+    tMax = INFINITY;
 
-    if (light.type == LightType::LIGHT_DIRECTIONAL) shadowRay.direction = glm::normalize(-glm::vec3(light.dir));
-    else shadowRay.direction = shadowRay.direction = glm::normalize((glm::vec3(light.pos) - position));
+    if (light.type == LightType::LIGHT_DIRECTIONAL) {
 
-    for (std::shared_ptr<Shape> shape : scene.getShapeData()) {
+        shadowRay.direction = glm::normalize(-glm::vec3(light.dir));
 
-        glm::vec3 originObject    = glm::vec3(shape->inverseCTM * glm::vec4(shadowRay.origin, 1.0f));
-        glm::vec3 directionObject = glm::vec3(shape->inverseCTM * glm::vec4(shadowRay.direction, 0.0f));
+    } else {
 
-        Ray objectSpaceRay = Ray {originObject, directionObject};
-        float t; glm::vec3 hitPoint;
+        // Blockers only count up to the light itself.
+        shadowRay.direction = glm::normalize((glm::vec3(light.pos) - position));
+        tMax = glm::length(glm::vec3(light.pos) - shadowRay.origin);
 
-        if (shape->rayIntersect(objectSpaceRay, t, hitPoint)) {
+    }
 
-            if (light.type == LightType::LIGHT_DIRECTIONAL) {
+    return shadowRay;
 
-                if (t > 0.0f) return false; // If any intersection is done in the direction of the light, there should be a shadow.
+}
 
-            } else {
+// Returns true if shadowRay, towards light number lightIndex, does not intersect with anything before tMax.
+bool isUnoccluded(const Ray &shadowRay,
+                  float tMax,
+                  const RayTraceScene& scene,
+                  int lightIndex,
+                  bool accelerate) {
 
-                glm::vec3 lightPosObject = glm::vec3(shape->inverseCTM * glm::vec4(glm::vec3(light.pos), 1.0f));
-                // If shape intersected with before light, return false.
-                if (t < glm::length(lightPosObject - hitPoint)) {
-                    return false;
-                }
+    if (lightIndex >= (int)lastOccluder.size()) lastOccluder.resize(lightIndex + 1, -1);
+    int &cached = lastOccluder[lightIndex];
 
-            }
+    // Cached Occluder --
+    if (cached >= 0 && cached < scene.primitiveCount() && scene.occluded(cached, shadowRay, tMax)) return false;
 
-        }
+    int occluder = -1;
+
+    if (accelerate) {
+
+        scene.getBVH().anyHit(shadowRay, tMax, [&](int index) {
+            if (index == cached || !scene.occluded(index, shadowRay, tMax)) return false;
+            occluder = index;
+            return true;
+        });
+
+    } else {
+
+        occluder = scene.findOccluder(shadowRay, tMax, cached);
 
     }
 
-    return true;
+    if (occluder < 0) return true;
+
+    cached = occluder;
+    return false;
+
+}
+
+// Returns true if shadow ray does not intersect with anything before reaching light -- false otherwise.
+// Should only be used by phong().
+bool traceShadowRay(glm::vec3 position,
+                    const RayTraceScene& scene,
+                    const SceneLightData &light,
+                    int lightIndex,
+                    glm::vec3 normal,
+                    bool accelerate) {
+
+    float tMax;
+    Ray shadowRay = shadowRayTowards(position, light, normal, tMax);
+
+    return isUnoccluded(shadowRay, tMax, scene, lightIndex, accelerate);
 
 }
 
 // Checks if material is reflective.
-bool isReflective(SceneMaterial& mat) {
+bool isReflective(const SceneMaterial& mat) {
     return mat.cReflective.r > 0.0f ||
            mat.cReflective.g > 0.0f ||
            mat.cReflective.b > 0.0f;
 }
 
+// The shadow rays of one wavefront generation. contributions[k] reaches colors[pixels[k]] if nothing blocks rays[k],
+// towards light number lights[k], before tMax[k].
+struct ShadowQueue {
+    std::vector<Ray> rays;
+    std::vector<float> tMax;
+    std::vector<int> lights;
+    std::vector<int> pixels;
+    std::vector<glm::vec3> contributions;
+};
+
 
 
 
@@ -93,134 +180,645 @@ bool isReflective(SceneMaterial& mat) {
 //                                                      ===== MAIN RAYTRACING FUNCTIONS ======
 void RayTracer::render(RGBA *imageData, const RayTraceScene &scene) {
 
+    renderSpans(scene, [&](int x0, int x1, int j, const glm::vec4 *colors) {
+        for (int i = x0; i < x1; i++) imageData[pointToIndex(i, j, scene.width())] = toRGBA(colors[i - x0]);
+    });
+
+}
+
+void RayTracer::render(glm::vec4 *imageData, const RayTraceScene &scene) {
+
+    renderSpans(scene, [&](int x0, int x1, int j, const glm::vec4 *colors) {
+        for (int i = x0; i < x1; i++) imageData[pointToIndex(i, j, scene.width())] = glm::vec4(glm::vec3(colors[i - x0]), 1.0f);
+    });
+
+}
+
+void RayTracer::renderProgressive(RGBA *imageData, const RayTraceScene &scene, const std::function<void(int)> &onPass) {
+
+    renderProgressiveSpans(scene, [&](int x0, int x1, int j, const glm::vec4 *colors) {
+        for (int i = x0; i < x1; i++) imageData[pointToIndex(i, j, scene.width())] = toRGBA(colors[i - x0]);
+    }, onPass);
+
+}
+
+void RayTracer::renderProgressive(glm::vec4 *imageData, const RayTraceScene &scene, const std::function<void(int)> &onPass) {
+
+    renderProgressiveSpans(scene, [&](int x0, int x1, int j, const glm::vec4 *colors) {
+        for (int i = x0; i < x1; i++) imageData[pointToIndex(i, j, scene.width())] = glm::vec4(glm::vec3(colors[i - x0]), 1.0f);
+    }, onPass);
+
+}
+
+RayTracer::BinningStats RayTracer::binningStats() const {
+
+    std::lock_guard<std::mutex> lock(m_binningMutex);
+    return m_binningStats;
+
+}
+
+RGBA RayTracer::toRGBA(const glm::vec4 &illumination) const {
+
+    glm::vec3 color = toneMap(glm::exp2(m_config.exposure) * glm::vec3(illumination), m_config.toneMap);
+
+    uint8_t r = (uint8_t)(255.0f * glm::min(glm::max(color[0], 0.0f), 1.0f));
+    uint8_t g = (uint8_t)(255.0f * glm::min(glm::max(color[1], 0.0f), 1.0f));
+    uint8_t b = (uint8_t)(255.0f * glm::min(glm::max(color[2], 0.0f), 1.0f));
+
+    return RGBA{r, g, b, 255};
+
+}
+
+void RayTracer::renderSpans(const RayTraceScene &scene, const SpanOutput &output) {
+
+    setupSampling(scene, false);
+
+    bool adaptive = m_config.superSamplerPattern == SuperSamplerPattern::Adaptive;
+
+    // Wavefronts take all the samples of a tile at once; adaptive rounds go through traceRays instead.
+    if (m_config.enableWavefront && !adaptive) {
+
+        forEachTile(scene, [&](const Tile &tile) {
+
+            int tileWidth = tile.x1 - tile.x0;
+            std::vector<glm::vec4> colors(tileWidth * (tile.y1 - tile.y0), glm::vec4(0.0f));
+
+            traceTileWavefront(tile, 0, spp, colors.data(), tileWidth, scene);
+            for (glm::vec4 &color : colors) color /= (float)spp;
+
+            for (int j = tile.y0; j < tile.y1; j++) output(tile.x0, tile.x1, j, &colors[(j - tile.y0) * tileWidth]);
+
+        });
+        return;
+
+    }
+
+    forEachSpan(scene, [&](int x0, int x1, int j) {
+
+        std::vector<glm::vec4> colors(x1 - x0, glm::vec4(0.0f));
+
+        if (adaptive) {
+
+            traceSpanAdaptive(x0, x1, j, colors.data(), scene);
+
+        } else {
+
+            traceSpan(x0, x1, j, 0, spp, colors.data(), scene);
+            for (glm::vec4 &color : colors) color /= (float)spp;
+
+        }
+
+        output(x0, x1, j, colors.data());
+
+    });
+
+}
+
+void RayTracer::renderProgressiveSpans(const RayTraceScene &scene, const SpanOutput &output, const std::function<void(int)> &onPass) {
+
+    setupSampling(scene, true);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<glm::vec4> accumulation(scene.width() * scene.height(), glm::vec4(0.0f));
+
+    int samplesDone = 0;
+
+    for (int passSamples = 1; samplesDone < spp; passSamples *= RAY_TRACE_PROGRESSIVE_FACTOR) {
+
+        int samplesTarget = glm::min(passSamples, spp);
+
+        auto outputEstimate = [&](int x0, int x1, int j) {
+
+            const glm::vec4 *colors = &accumulation[pointToIndex(x0, j, scene.width())];
+
+            std::vector<glm::vec4> estimate(colors, colors + (x1 - x0));
+            for (glm::vec4 &color : estimate) color /= (float)samplesTarget;
+
+            output(x0, x1, j, estimate.data());
+
+        };
+
+        if (m_config.enableWavefront) {
+
+            forEachTile(scene, [&](const Tile &tile) {
+
+                glm::vec4 *colors = &accumulation[pointToIndex(tile.x0, tile.y0, scene.width())];
+                traceTileWavefront(tile, samplesDone, samplesTarget, colors, scene.width(), scene);
+
+                for (int j = tile.y0; j < tile.y1; j++) outputEstimate(tile.x0, tile.x1, j);
+
+            });
+
+        } else {
+
+            forEachSpan(scene, [&](int x0, int x1, int j) {
+                traceSpan(x0, x1, j, samplesDone, samplesTarget, &accumulation[pointToIndex(x0, j, scene.width())], scene);
+                outputEstimate(x0, x1, j);
+            });
+
+        }
+
+        samplesDone = samplesTarget;
+        onPass(samplesDone);
+
+        // Time Budget --
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        if (m_config.timeBudgetMs > 0 && elapsed.count() >= m_config.timeBudgetMs) break;
+
+    }
+
+}
+
+void RayTracer::setupSampling(const RayTraceScene &scene, bool progressive) {
+
     // Samples per pixel initializing .
     spp_sqrt = glm::ceil(glm::sqrt(m_config.samplesPerPixel));
     spp = spp_sqrt * spp_sqrt;
 
-    // Choosing which type of sampling to do !
-    bool randomSampling = false;
-    bool uniformSampling = false;
-    bool stratifiedSampling = false;
+    // Progressive passes and adaptive rounds take the samples in a strided order, so early samples spread
+    // over the whole pixel instead of filling the grid row by row. A stride of a * spp_sqrt + 1 with a
+    // coprime to spp_sqrt walks the grid as a rank-1 lattice: each run of spp_sqrt samples covers every
+    // column, the first one also every row, and the stride is coprime to spp, so no sample repeats.
+    sampleStride = 1;
+
+    if ((progressive || m_config.superSamplerPattern == SuperSamplerPattern::Adaptive) && spp > 1) {
+        int a = glm::max((int)(0.618f * spp_sqrt), 1);
+        while (std::gcd(a, spp_sqrt) != 1) a++;
+        sampleStride = a * spp_sqrt + 1;
+    }
+
+    // For differential calculations. Kept here rather than in the camera, which renders of other configs may share.
+    r_bar = scene.getCamera().calculateR(spp);
+
+}
+
+// Calls renderTile for every tile of the image, on the tile scheduler when parallelism is enabled.
+void RayTracer::forEachTile(const RayTraceScene &scene, const std::function<void(const Tile &)> &renderTile) {
+
+    if (m_config.enableParallelism) {
+
+        // Tile-Based Parallel Rendering --
+        TileScheduler scheduler(scene.width(), scene.height(), RAY_TRACE_TILE_SIZE, m_config.threadCount);
+        scheduler.run(renderTile);
+
+    } else {
+
+        for (int y = 0; y < scene.height(); y += RAY_TRACE_TILE_SIZE) {
+            for (int x = 0; x < scene.width(); x += RAY_TRACE_TILE_SIZE) {
+                renderTile(Tile{x, y, glm::min(x + RAY_TRACE_TILE_SIZE, scene.width()), glm::min(y + RAY_TRACE_TILE_SIZE, scene.height())});
+            }
+        }
+
+    }
+
+}
+
+// Calls span(x0, x1, j) for every row segment of the image, on the tile scheduler when parallelism is enabled.
+void RayTracer::forEachSpan(const RayTraceScene &scene, const std::function<void(int, int, int)> &span) {
+
+    if (m_config.enableParallelism) {
+
+        forEachTile(scene, [&](const Tile &tile) {
+            for (int j = tile.y0; j < tile.y1; j++) {
+                span(tile.x0, tile.x1, j);
+            }
+        });
+
+    } else {
+
+        for (int j = 0; j < scene.height(); j++) {
+            span(0, scene.width(), j);
+        }
+
+    }
+
+}
+
+// Generates primary ray number sample (out of spp) through pixel (i, j), placed by the configured sampling pattern.
+Ray RayTracer::primaryRay(int i, int j, int sample, const RayTraceScene &scene) const {
+
+    std::uint32_t pixelIndex = pointToIndex(i, j, scene.width());
+
+    int ix = sample % spp_sqrt;
+    int iy = sample / spp_sqrt;
+
+    float jx = 0.0f;
+    float jy = 0.0f;
 
     switch(m_config.superSamplerPattern) {
 
-    case SuperSamplerPattern::Grid:
-        uniformSampling = true;
+    case SuperSamplerPattern::Grid: {
+
+        // Uniform Sampling ---
+        jx = (ix + 0.5f) / (float)spp_sqrt;
+        jy = (iy + 0.5f) / (float)spp_sqrt;
         break;
-    case SuperSamplerPattern::Random:
-        randomSampling = true;
+
+    }
+    case SuperSamplerPattern::Random: {
+
+        // Random Sampling ---
+        glm::vec2 jitter = m_sampler.get2D(pixelIndex, sample, SampleDimension::PixelX);
+
+        jx = jitter.x;
+        jy = jitter.y;
         break;
+
+    }
     case SuperSamplerPattern::Stratified:
-        stratifiedSampling = true;
+    case SuperSamplerPattern::Adaptive: {
+
+        // Stratified Sampling ---
+        glm::vec2 jitter = m_sampler.get2D(pixelIndex, sample, SampleDimension::PixelX);
+
+        jx = (ix + jitter.x) / spp_sqrt;
+        jy = (iy + jitter.y) / spp_sqrt;
         break;
+
+    }
     }
 
-    // For differential calculations.
-    scene.getCamera().calculateR(spp);
+    const Camera &camera = scene.getCamera();
+    float px = (float)i + jx;
+    float py = (float)j + jy;
 
-    for (int j = 0; j < scene.height(); j++) {
-        for (int i = 0; i < scene.width(); i++) {
+    if (!m_config.enableDepthOfField || camera.getAperture() <= 0.0f || camera.getFocalLength() <= 0.0f) {
+        return cameraRay(camera, camera.generateRay(py, px));
+    }
 
-            if (randomSampling) {
+    return cameraRay(camera, camera.generateRay(py, px, lensSample(pixelIndex, sample)));
 
-                // Random Sampling
-                glm::vec4 color = glm::vec4(0.0f);
-                for (int sample = 0; sample < spp; sample++) {
+}
 
-                    float px = (float)i + dis(gen);
-                    float py = (float)j + dis(gen);
+// Picks the point of the lens, in [0, 1)^2, that sample number sample of a pixel leaves from.
+// The lens is split into the same spp_sqrt x spp_sqrt strata as the pixel, and each pixel pairs its pixel strata with
+// the lens strata in a random order of its own. After spp samples every pixel stratum and every lens stratum has been
+// used once, so the depth of field converges along with the antialiasing instead of needing samples of its own.
+glm::vec2 RayTracer::lensSample(std::uint32_t pixelIndex, int sample) const {
 
-                    Ray ray = scene.getCamera().generateRay(py, px);
-                    glm::vec4 originWorld = scene.getCamera().getInverseViewMatrix() * glm::vec4(ray.origin, 1.0f);
-                    glm::vec4 directionWorld = scene.getCamera().getInverseViewMatrix() * glm::vec4(ray.direction, 0.0f);
+    if (m_config.superSamplerPattern == SuperSamplerPattern::Random) {
+        return m_sampler.get2D(pixelIndex, sample, SampleDimension::LensU);
+    }
 
-                    ray.origin    = glm::vec3(originWorld);
-                    ray.direction = glm::normalize(glm::vec3(directionWorld));
-                    ray.unnormalizedDirection = glm::vec3(directionWorld);
+    int stratum = (int)m_sampler.permute(sample, spp, pixelIndex, SampleDimension::LensU);
 
-                    color += raytrace(ray, scene, 0);
+    glm::vec2 jitter(0.5f);
+    if (m_config.superSamplerPattern != SuperSamplerPattern::Grid) {
+        jitter = m_sampler.get2D(pixelIndex, sample, SampleDimension::LensU);
+    }
 
-                }
+    return (glm::vec2(stratum % spp_sqrt, stratum / spp_sqrt) + jitter) / (float)spp_sqrt;
 
-                color = color / (float)spp;
-                imageData[pointToIndex(i, j, scene.width())] = toRGBA(color);
+}
 
-            } else if (uniformSampling) {
+// Adds samples [sampleBegin, sampleEnd) of pixels [x0, x1) in row j to colors[i - x0]. Only reads
+// shared state, so it is safe to call from any thread. With packet tracing, the primary rays of the
+// whole span are intersected RAY_PACKET_WIDTH at a time; each sample is still added to its pixel in order.
+void RayTracer::traceSpan(int x0, int x1, int j, int sampleBegin, int sampleEnd, glm::vec4 *colors, const RayTraceScene &scene) {
 
-                // Uniform Sampling ---
-                glm::vec4 color = glm::vec4(0.0f);
+    if (!m_config.enablePacketTracing) {
 
-                for (int iy = 0; iy < spp_sqrt; iy++) {
-                    for (int ix = 0; ix < spp_sqrt; ix++) {
+        for (int i = x0; i < x1; i++) {
+            for (int k = sampleBegin; k < sampleEnd; k++) {
+                colors[i - x0] += raytrace(primaryRay(i, j, (k * sampleStride) % spp, scene), scene, 0, glm::vec3(1.0f));
+            }
+        }
+        return;
 
-                        float jx = (ix + 0.5f) / (float)spp_sqrt;
-                        float jy = (iy + 0.5f) / (float)spp_sqrt;
+    }
 
-                        float px = (float)i + jx;
-                        float py = (float)j + jy;
+    Ray batch[RAY_PACKET_WIDTH];
+    int owners[RAY_PACKET_WIDTH];
+    glm::vec4 batchColors[RAY_PACKET_WIDTH];
+    int batchSize = 0;
 
-                        Ray ray = scene.getCamera().generateRay(py, px);
-                        glm::vec4 originWorld = scene.getCamera().getInverseViewMatrix() * glm::vec4(ray.origin, 1.0f);
-                        glm::vec4 directionWorld = scene.getCamera().getInverseViewMatrix() * glm::vec4(ray.direction, 0.0f);
+    auto flush = [&]() {
+        raytracePacket(batch, batchSize, scene, batchColors);
+        for (int lane = 0; lane < batchSize; lane++) colors[owners[lane]] += batchColors[lane];
+        batchSize = 0;
+    };
 
-                        ray.origin    = glm::vec3(originWorld);
-                        ray.direction = glm::normalize(glm::vec3(directionWorld));
-                        ray.unnormalizedDirection = glm::vec3(directionWorld);
+    for (int i = x0; i < x1; i++) {
+        for (int k = sampleBegin; k < sampleEnd; k++) {
 
-                        color += raytrace(ray, scene, 0);
+            batch[batchSize] = primaryRay(i, j, (k * sampleStride) % spp, scene);
+            owners[batchSize] = i - x0;
+            if (++batchSize == RAY_PACKET_WIDTH) flush();
 
-                    }
-                }
+        }
+    }
+
+    if (batchSize > 0) flush();
+
+}
+
+// Renders pixels [x0, x1) of row j with adaptive sampling and writes their final colors to colors[i - x0].
+// Every pixel starts with RAY_TRACE_ADAPTIVE_BATCH samples, then keeps getting batches of that size while
+// the standard error of its luminance is above the threshold, up to spp. Each round batches the rays
+// of every pixel still sampling, so packets stay full.
+void RayTracer::traceSpanAdaptive(int x0, int x1, int j, glm::vec4 *colors, const RayTraceScene &scene) {
+
+    struct Estimate {
+        int count = 0;
+        float mean = 0.0f; // Running luminance mean and squared deviations (Welford)
+        float m2 = 0.0f;
+        bool done = false;
+    };
+
+    std::vector<Estimate> estimates(x1 - x0);
+    std::vector<Ray> rays;
+    std::vector<int> owners;
+    std::vector<glm::vec4> rayColors;
+
+    while (true) {
+
+        rays.clear();
+        owners.clear();
 
-                color = color / (float)spp;
-                imageData[pointToIndex(i, j, scene.width())] = toRGBA(color);
+        for (int i = x0; i < x1; i++) {
 
-            } else if (stratifiedSampling) {
+            Estimate &estimate = estimates[i - x0];
+            if (estimate.done) continue;
 
-                // Stratified Sampling ---
-                glm::vec4 color = glm::vec4(0.0f);
+            int batchEnd = glm::min(estimate.count + RAY_TRACE_ADAPTIVE_BATCH, spp);
+            for (int k = estimate.count; k < batchEnd; k++) {
+                rays.push_back(primaryRay(i, j, (k * sampleStride) % spp, scene));
+                owners.push_back(i - x0);
+            }
+
+        }
+
+        if (rays.empty()) break;
+
+        rayColors.resize(rays.size());
+        traceRays(rays.data(), (int)rays.size(), scene, rayColors.data());
+
+        for (int r = 0; r < (int)rays.size(); r++) {
+
+            Estimate &estimate = estimates[owners[r]];
+            glm::vec3 clamped = glm::clamp(glm::vec3(rayColors[r]), 0.0f, 1.0f);
+            float luminance = glm::dot(clamped, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+
+            colors[owners[r]] += rayColors[r];
+
+            estimate.count++;
+            float delta = luminance - estimate.mean;
+            estimate.mean += delta / estimate.count;
+            estimate.m2 += delta * (luminance - estimate.mean);
+
+        }
+
+        // Convergence --
+        for (Estimate &estimate : estimates) {
+
+            if (estimate.done) continue;
+
+            float variance = (estimate.count > 1) ? estimate.m2 / (estimate.count - 1) : 0.0f;
+            float standardError = glm::sqrt(variance / estimate.count);
+
+            estimate.done = estimate.count >= spp || standardError <= m_config.adaptiveThreshold;
+
+        }
+
+    }
+
+    for (int i = x0; i < x1; i++) {
+        colors[i - x0] /= (float)estimates[i - x0].count;
+    }
+
+}
+
+// Traces count primary rays and writes the color of ray k to colors[k].
+void RayTracer::traceRays(const Ray *rays, int count, const RayTraceScene &scene, glm::vec4 *colors) {
+
+    if (m_config.enableWavefront) {
+
+        RayQueue queue;
+        queue.rays.assign(rays, rays + count);
+        queue.pixels.resize(count);
+        std::iota(queue.pixels.begin(), queue.pixels.end(), 0);
+        queue.weights.assign(count, glm::vec3(1.0f));
+
+        std::fill(colors, colors + count, glm::vec4(0.0f));
+        traceWavefront(queue, scene, colors);
+        return;
+
+    }
+
+    if (!m_config.enablePacketTracing) {
+
+        for (int k = 0; k < count; k++) colors[k] = raytrace(rays[k], scene, 0, glm::vec3(1.0f));
+        return;
+
+    }
+
+    for (int first = 0; first < count; first += RAY_PACKET_WIDTH) {
+        raytracePacket(rays + first, glm::min(RAY_PACKET_WIDTH, count - first), scene, colors + first);
+    }
+
+}
+
+// Adds samples [sampleBegin, sampleEnd) of every pixel (i, j) of tile to colors[(j - tile.y0) * stride + i - tile.x0],
+// in wavefronts of up to RAY_TRACE_WAVEFRONT_SIZE primary rays.
+void RayTracer::traceTileWavefront(const Tile &tile, int sampleBegin, int sampleEnd, glm::vec4 *colors, int stride, const RayTraceScene &scene) {
+
+    int tileWidth = tile.x1 - tile.x0;
+    int samples = sampleEnd - sampleBegin;
+    int rayCount = tileWidth * (tile.y1 - tile.y0) * samples;
+
+    RayQueue queue;
+
+    for (int first = 0; first < rayCount; first += RAY_TRACE_WAVEFRONT_SIZE) {
+
+        queue.rays.clear();
+        queue.pixels.clear();
+        queue.weights.clear();
+
+        // Ray r is sample r % samples of pixel r / samples, so each pixel's samples are traced together.
+        for (int r = first; r < glm::min(first + RAY_TRACE_WAVEFRONT_SIZE, rayCount); r++) {
+
+            int pixel = r / samples;
+            int i = tile.x0 + pixel % tileWidth;
+            int j = tile.y0 + pixel / tileWidth;
+            int k = sampleBegin + r % samples;
+
+            queue.rays.push_back(primaryRay(i, j, (k * sampleStride) % spp, scene));
+            queue.pixels.push_back((j - tile.y0) * stride + (i - tile.x0));
+            queue.weights.push_back(glm::vec3(1.0f));
+
+        }
+
+        traceWavefront(queue, scene, colors);
 
-                for (int iy = 0; iy < spp_sqrt; iy++) {
-                    for (int ix = 0; ix < spp_sqrt; ix++) {
+    }
+
+}
+
+// Traces the rays of queue breadth first, adding their colors to colors. Rather than following each path to its end
+// (raytrace() and shade()), the whole queue is intersected as a batch, in packets with packet tracing; its hits are
+// shaded, and the shadow rays and the reflection and refraction rays they spawn are gathered into queues of their own.
+// The shadow queue is tested next, and the other queue becomes the next generation. Gives the image of raytrace() up
+// to rounding.
+// The queue is used up.
+void RayTracer::traceWavefront(RayQueue &queue, const RayTraceScene &scene, glm::vec4 *colors) {
+
+    const SceneGlobalData &globalData = scene.getGlobalData();
+    const std::vector<SceneLightData> &lights = scene.getLightData();
+
+    std::vector<ShapeHit> hits;
+    ShadowQueue shadows;
+    RayQueue nextGeneration;
+
+    for (int depth = 0; !queue.rays.empty(); depth++) {
+
+        // Secondary rays leave the surfaces they bounce off in every direction, so they are sorted to trace
+        // rays going the same way from the same part of the scene together.
+        if (depth > 0 && m_config.enableRayBinning) binRays(queue, scene);
+
+        // Intersection --
+        hits.assign(queue.rays.size(), ShapeHit());
+        intersectRays(queue.rays.data(), (int)queue.rays.size(), scene, hits.data());
+
+        shadows = ShadowQueue();
+        nextGeneration = RayQueue();
+
+        // Shading --
+        for (int r = 0; r < (int)queue.rays.size(); r++) {
+
+            const ShapeHit &hit = hits[r];
+            if (hit.shapeIndex < 0) continue;
 
-                        float jx = (ix + dis(gen)) / spp_sqrt;
-                        float jy = (iy + dis(gen)) / spp_sqrt;
+            const Ray &ray = queue.rays[r];
+            const glm::vec3 &weight = queue.weights[r];
+            const SceneMaterial &material = scene.getShapeData()[hit.shapeIndex]->shapeInfo.primitive.material;
 
-                        float px = (float)i + jx;
-                        float py = (float)j + jy;
+            SurfacePoint surface = surfacePoint(ray, hit, scene);
+            glm::vec3 normal = glm::normalize(surface.normal);
+            glm::vec3 directionToCamera = glm::normalize(-ray.direction);
 
-                        Ray ray = scene.getCamera().generateRay(py, px);
-                        glm::vec4 originWorld = scene.getCamera().getInverseViewMatrix() * glm::vec4(ray.origin, 1.0f);
-                        glm::vec4 directionWorld = scene.getCamera().getInverseViewMatrix() * glm::vec4(ray.direction, 0.0f);
+            colors[queue.pixels[r]] += glm::vec4(weight * glm::vec3(globalData.ka * material.cAmbient), 0.0f);
 
-                        ray.origin    = glm::vec3(originWorld);
-                        ray.direction = glm::normalize(glm::vec3(directionWorld));
-                        ray.unnormalizedDirection = glm::vec3(directionWorld);
+            for (int lightIndex = 0; lightIndex < (int)lights.size(); lightIndex++) {
 
-                        color += raytrace(ray, scene, 0);
+                glm::vec3 contribution = weight * glm::vec3(lightContribution(surface.position, normal, directionToCamera, scene,
+                                                                              material, lights[lightIndex], surface.textureColor));
+
+                // Lights that add nothing (e.g. behind the surface) need no shadow ray.
+                if (contribution == glm::vec3(0.0f)) continue;
+
+                float tMax;
+                shadows.rays.push_back(shadowRayTowards(surface.position, lights[lightIndex], normal, tMax));
+                shadows.tMax.push_back(tMax);
+                shadows.lights.push_back(lightIndex);
+                shadows.pixels.push_back(queue.pixels[r]);
+                shadows.contributions.push_back(contribution);
+
+            }
+
+            if (depth < m_config.maxRecursiveDepth) {
+
+                SpawnedRay spawned[2];
+                int spawnedCount = spawnRays(ray, surface, material, scene, spawned);
+
+                for (int k = 0; k < spawnedCount; k++) {
+
+                    if (!continuePath(spawned[k], weight, depth)) continue;
+
+                    nextGeneration.rays.push_back(spawned[k].ray);
+                    nextGeneration.pixels.push_back(queue.pixels[r]);
+                    nextGeneration.weights.push_back(weight * spawned[k].weight);
 
-                    }
                 }
 
-                color = color / (float)spp;
-                imageData[pointToIndex(i, j, scene.width())] = toRGBA(color);
+            }
 
-            } else {
+        }
 
-                // Normal Sampling ---
-                Ray ray = scene.getCamera().generateRay(j, i);
-                glm::vec4 originWorld = scene.getCamera().getInverseViewMatrix() * glm::vec4(ray.origin, 1.0f);
-                glm::vec4 directionWorld = scene.getCamera().getInverseViewMatrix() * glm::vec4(ray.direction, 0.0f);
+        // Shadow Rays --
+        for (int r = 0; r < (int)shadows.rays.size(); r++) {
+            if (isUnoccluded(shadows.rays[r], shadows.tMax[r], scene, shadows.lights[r], m_config.enableAcceleration)) {
+                colors[shadows.pixels[r]] += glm::vec4(shadows.contributions[r], 0.0f);
+            }
+        }
+
+        std::swap(queue, nextGeneration);
+
+    }
+
+}
+
+// Sorts the rays of queue by their RayBinning bins and adds the packet coherence before and after to the stats.
+void RayTracer::binRays(RayQueue &queue, const RayTraceScene &scene) {
+
+    const std::vector<BVH::Node> &nodes = scene.getBVH().nodes();
+    AABB bounds = nodes.empty() ? AABB() : nodes.front().bounds;
+
+    int count = (int)queue.rays.size();
+
+    std::vector<std::uint32_t> bins(count);
+    for (int r = 0; r < count; r++) bins[r] = RayBinning::bin(queue.rays[r], bounds);
+
+    std::vector<int> order;
+    RayBinning::sortByBin(bins, order);
 
-                ray.origin    = glm::vec3(originWorld);
-                ray.direction = glm::normalize(glm::vec3(directionWorld));
-                ray.unnormalizedDirection = glm::vec3(directionWorld);
+    RayQueue sorted;
+    std::vector<std::uint32_t> sortedBins(count);
 
-                imageData[pointToIndex(i, j, scene.width())] = toRGBA(raytrace(ray, scene, 0));
+    sorted.rays.reserve(count);
+    sorted.pixels.reserve(count);
+    sorted.weights.reserve(count);
 
+    for (int r = 0; r < count; r++) {
+        sorted.rays.push_back(queue.rays[order[r]]);
+        sorted.pixels.push_back(queue.pixels[order[r]]);
+        sorted.weights.push_back(queue.weights[order[r]]);
+        sortedBins[r] = bins[order[r]];
+    }
+
+    int binsBefore = RayBinning::packetBins(bins.data(), count, RAY_PACKET_WIDTH);
+    int binsAfter = RayBinning::packetBins(sortedBins.data(), count, RAY_PACKET_WIDTH);
+
+    queue = std::move(sorted);
+
+    std::lock_guard<std::mutex> lock(m_binningMutex);
+    m_binningStats.rays += count;
+    m_binningStats.packets += (count + RAY_PACKET_WIDTH - 1) / RAY_PACKET_WIDTH;
+    m_binningStats.binsBefore += binsBefore;
+    m_binningStats.binsAfter += binsAfter;
+
+}
+
+// Finds the closest hit of each of count rays, RAY_PACKET_WIDTH at a time with packet tracing. hits start out empty.
+void RayTracer::intersectRays(const Ray *rays, int count, const RayTraceScene &scene, ShapeHit *hits) {
+
+    if (!m_config.enablePacketTracing) {
+
+        for (int k = 0; k < count; k++) {
+            if (m_config.enableAcceleration) {
+                scene.getBVH().closestHit(rays[k], hits[k].t, [&](int index) { scene.intersect(index, rays[k], hits[k]); });
+            } else {
+                scene.intersectAll(rays[k], hits[k]);
             }
+        }
+        return;
 
+    }
+
+    // Packet Intersection Checking --
+    for (int first = 0; first < count; first += RAY_PACKET_WIDTH) {
+
+        int size = glm::min(RAY_PACKET_WIDTH, count - first);
+        RayPacket packet = RayPacket::gather(rays + first, size);
+        PacketHit hit;
+
+        if (m_config.enableAcceleration) {
+            scene.getBVH().closestHit(packet, hit.t, [&](int index) { scene.intersect(index, packet, hit); });
+        } else {
+            scene.intersectAll(packet, hit);
         }
+
+        std::copy(hit.lanes, hit.lanes + size, hits + first);
+
     }
 
 }
@@ -228,138 +826,262 @@ void RayTracer::render(RGBA *imageData, const RayTraceScene &scene) {
 // Should return an RGBA value as vec4 of ints.
 glm::vec4 RayTracer::raytrace(Ray ray,
                               const RayTraceScene &scene,
-                              int recursiveDepth) {
+                              int recursiveDepth,
+                              glm::vec3 throughput) {
 
-    float t;
-    glm::vec3 hitPoint;
-    glm::vec3 hitPointObject;
-    glm::vec3 normal;
-    float smallestT = INFINITY;
-
-    std::shared_ptr<Shape> closestShape;
+    ShapeHit hit;
 
     // Object Intersection Checking --
-    for (std::shared_ptr<Shape> shape : scene.getShapeData()) {
+    if (m_config.enableAcceleration) {
+
+        scene.getBVH().closestHit(ray, hit.t, [&](int index) { scene.intersect(index, ray, hit); });
+
+    } else {
+
+        scene.intersectAll(ray, hit);
+
+    }
+
+    return shade(ray, hit, scene, recursiveDepth, throughput);
+
+}
+
+// Traces up to RAY_PACKET_WIDTH rays together and writes the color of ray k to colors[k].
+// Only the intersection is done as a packet; shading and secondary rays stay per ray.
+void RayTracer::raytracePacket(const Ray *rays,
+                               int count,
+                               const RayTraceScene &scene,
+                               glm::vec4 *colors) {
+
+    ShapeHit hits[RAY_PACKET_WIDTH];
+    intersectRays(rays, count, scene, hits);
+
+    for (int lane = 0; lane < count; lane++) {
+        colors[lane] = shade(rays[lane], hits[lane], scene, 0, glm::vec3(1.0f));
+    }
+
+}
+
+// Computes the color seen along ray, given its closest intersection.
+glm::vec4 RayTracer::shade(const Ray &ray,
+                           const ShapeHit &hit,
+                           const RayTraceScene &scene,
+                           int recursiveDepth,
+                           glm::vec3 throughput) {
+
+    // Color Calculations --
+
+    if (hit.shapeIndex < 0) {
+
+        return glm::vec4(0, 0, 0, 1);
 
-        glm::vec3 originObject    = glm::vec3(shape->inverseCTM * glm::vec4(ray.origin, 1.0f));
-        glm::vec3 directionObject = glm::vec3(shape->inverseCTM * glm::vec4(ray.direction, 0.0f));
+    }
 
-        Ray objectSpaceRay = Ray {originObject, directionObject};
+    const std::shared_ptr<Shape> &closestShape = scene.getShapeData()[hit.shapeIndex];
+    SurfacePoint surface = surfacePoint(ray, hit, scene);
 
-        if (shape->rayIntersect(objectSpaceRay, t, hitPoint)) {
+    glm::vec4 color = phong(surface.position,
+                            surface.normal,
+                            -ray.direction,
+                            scene,
+                            closestShape,
+                            scene.getLightData(),
+                            surface.textureColor);
 
-            glm::vec3 hitPointWorld = glm::vec3(shape->shapeInfo.ctm * glm::vec4(hitPoint, 1.0f));
-            float tWorld = glm::length(hitPointWorld - ray.origin);
+    // Reflective and Refractive Ray Handling --
+    if (recursiveDepth < m_config.maxRecursiveDepth) {
 
-            if (tWorld < smallestT && tWorld > 1e-6f) {
+        SpawnedRay spawned[2];
+        int spawnedCount = spawnRays(ray, surface, closestShape->shapeInfo.primitive.material, scene, spawned);
 
+        for (int k = 0; k < spawnedCount; k++) {
 
-                normal = shape->computeNormal(hitPoint); // Object Space
-                smallestT = tWorld; // World Space
-                closestShape = shape; // World Space
-                hitPointObject = hitPoint; // Object Space
+            if (!continuePath(spawned[k], throughput, recursiveDepth)) continue;
 
-            };
+            glm::vec4 spawnedColor = raytrace(spawned[k].ray, scene, recursiveDepth + 1, throughput * spawned[k].weight);
+            color += glm::vec4(spawned[k].weight * glm::vec3(spawnedColor), 0.0f);
 
         }
 
     }
 
-    // Color Calculations --
+    return color;
 
-    t = smallestT;
-    glm::vec4 color;
+}
 
-    if (std::isinf(t)) {
+// Decides whether the path through a ray spawned at depth goes on, given the throughput of the ray that spawned it.
+// Paths whose throughput would fall below minThroughput end here, which cannot make a visible difference but darkens
+// the image slightly. With Russian roulette, paths below rouletteThreshold go on with a probability proportional to
+// their throughput instead, and the weight of the ones that do is raised to make up for the others, which keeps the
+// image unbiased at the cost of some noise.
+bool RayTracer::continuePath(SpawnedRay &spawned, glm::vec3 throughput, int depth) const {
 
-        return glm::vec4(0, 0, 0, 1);
+    float pathThroughput = glm::compMax(throughput * spawned.weight);
 
-    } else {
+    if (!m_config.enableRussianRoulette) return pathThroughput >= m_config.minThroughput;
+    if (pathThroughput >= m_config.rouletteThreshold) return true;
+
+    float survival = pathThroughput / m_config.rouletteThreshold;
+    if (m_sampler.get1D(rayKey(spawned.ray), depth, SampleDimension::Roulette) >= survival) return false;
 
-        glm::vec4 textureColor;
+    spawned.weight /= survival;
+    return true;
+
+}
 
-        // Texture Calculations --
-        glm::vec3 normalWorld = glm::vec3(glm::sign(glm::determinant(glm::mat3(closestShape->shapeInfo.ctm))) *
-                                          glm::transpose(glm::mat3(closestShape->inverseCTM)) * normal);
+// Finds where a hit (hit.shapeIndex >= 0) lies in world space, its normal there and its texture color.
+RayTracer::SurfacePoint RayTracer::surfacePoint(const Ray &ray, const ShapeHit &hit, const RayTraceScene &scene) {
 
-        float side = glm::dot(normalWorld, glm::normalize(-ray.direction));
-        normalWorld = (side > 0) ? normalWorld : -normalWorld;
+    float t = hit.t;
 
-        if (closestShape->shapeInfo.primitive.material.textureMap.isUsed) {
+    const std::shared_ptr<Shape> &closestShape = scene.getShapeData()[hit.shapeIndex];
+    glm::vec3 hitPointObject = hit.hitPointObject; // Object Space
+    glm::vec3 normal = closestShape->computeNormal(hitPointObject, hit.face, hit.barycentric); // Object Space
 
-            // dp_dx and dp_dy calculations
-            glm::vec4 rWorldX = scene.getCamera().getInverseViewMatrix() * glm::vec4(std::get<0>(scene.getCamera().r_bar), 0.0f);
-            glm::vec4 rWorldY = scene.getCamera().getInverseViewMatrix() * glm::vec4(std::get<1>(scene.getCamera().r_bar), 0.0f);
+    SurfacePoint surface;
 
-            glm::vec3 dd_dx = (glm::vec3(rWorldX) * glm::dot(ray.unnormalizedDirection, ray.unnormalizedDirection) -
-                               glm::dot(ray.unnormalizedDirection, glm::vec3(rWorldX)) * ray.unnormalizedDirection) /
-                               std::pow(glm::dot(ray.unnormalizedDirection, ray.unnormalizedDirection), 3.0f / 2.0f);
-            float dt_dx = -(glm::dot(normalWorld, t * dd_dx)) / glm::dot(normalWorld, ray.direction);
+    // A shape of a template is placed by its instance as well.
+    glm::mat4 ctm = closestShape->shapeInfo.ctm;
+    glm::mat4 inverseCTM = closestShape->inverseCTM;
 
-            glm::vec3 dd_dy = (glm::vec3(rWorldY) * glm::dot(ray.unnormalizedDirection, ray.unnormalizedDirection) -
-                               glm::dot(ray.unnormalizedDirection, glm::vec3(rWorldY)) * ray.unnormalizedDirection) /
-                               std::pow(glm::dot(ray.unnormalizedDirection, ray.unnormalizedDirection), 3.0f / 2.0f);
-            float dt_dy = -(glm::dot(normalWorld, t * dd_dy)) / glm::dot(normalWorld, ray.direction);
+    if (hit.instance >= 0) {
+        ctm = scene.getInstanceArrays().ctm(hit.instance) * ctm;
+        inverseCTM = inverseCTM * scene.getInstanceArrays().inverseCTM(hit.instance);
+    }
 
-            glm::vec3 dp_dx = t * dd_dx + dt_dx * ray.direction;
-            glm::vec3 dp_dy = t * dd_dy + dt_dy * ray.direction;
+    // Texture Calculations --
+    glm::vec3 normalWorld = glm::vec3(glm::sign(glm::determinant(glm::mat3(ctm))) *
+                                      glm::transpose(glm::mat3(inverseCTM)) * normal);
 
-            // Computing Differentials for Shape --
-            std::tuple<glm::vec3, glm::vec3> differentials = closestShape->computeDifferentials(hitPoint);
+    float side = glm::dot(normalWorld, glm::normalize(-ray.direction));
+    normalWorld = (side > 0) ? normalWorld : -normalWorld;
 
-            textureColor = texture(closestShape->texture, differentials, hitPoint, dp_dx, dp_dy, closestShape);
+    if (closestShape->shapeInfo.primitive.material.textureMap.isUsed) {
 
-        }
+        // dp_dx and dp_dy calculations
+        glm::vec4 rWorldX = scene.getCamera().getInverseViewMatrix() * glm::vec4(std::get<0>(r_bar), 0.0f);
+        glm::vec4 rWorldY = scene.getCamera().getInverseViewMatrix() * glm::vec4(std::get<1>(r_bar), 0.0f);
+
+        glm::vec3 dd_dx = (glm::vec3(rWorldX) * glm::dot(ray.unnormalizedDirection, ray.unnormalizedDirection) -
+                           glm::dot(ray.unnormalizedDirection, glm::vec3(rWorldX)) * ray.unnormalizedDirection) /
+                           std::pow(glm::dot(ray.unnormalizedDirection, ray.unnormalizedDirection), 3.0f / 2.0f);
+        float dt_dx = -(glm::dot(normalWorld, t * dd_dx)) / glm::dot(normalWorld, ray.direction);
 
-        glm::vec3 hitPointWorld = glm::vec3(closestShape->shapeInfo.ctm * glm::vec4(hitPointObject, 1.0f));
+        glm::vec3 dd_dy = (glm::vec3(rWorldY) * glm::dot(ray.unnormalizedDirection, ray.unnormalizedDirection) -
+                           glm::dot(ray.unnormalizedDirection, glm::vec3(rWorldY)) * ray.unnormalizedDirection) /
+                           std::pow(glm::dot(ray.unnormalizedDirection, ray.unnormalizedDirection), 3.0f / 2.0f);
+        float dt_dy = -(glm::dot(normalWorld, t * dd_dy)) / glm::dot(normalWorld, ray.direction);
 
-        color = phong(hitPointWorld,
-                      normalWorld,
-                      -ray.direction,
-                      scene,
-                      closestShape,
-                      scene.getLightData(),
-                      textureColor);
+        glm::vec3 dp_dx = t * dd_dx + dt_dx * ray.direction;
+        glm::vec3 dp_dy = t * dd_dy + dt_dy * ray.direction;
 
-        // Reflective Ray Handling --
-        if (recursiveDepth < m_config.maxRecursiveDepth && isReflective(closestShape->shapeInfo.primitive.material)) {
+        // Computing Differentials for Shape --
+        std::tuple<glm::vec3, glm::vec3> differentials = closestShape->computeDifferentials(hitPointObject, hit.face, hit.barycentric);
 
-            Ray reflectedRay;
-            SceneMaterial material = closestShape->shapeInfo.primitive.material;
+        surface.textureColor = texture(*closestShape->texture, differentials, hit, dp_dx, dp_dy, closestShape, inverseCTM);
+
+    }
+
+    surface.position = glm::vec3(ctm * glm::vec4(hitPointObject, 1.0f));
+    surface.normal = normalWorld;
+    surface.frontFace = side > 0;
+
+    return surface;
+
+}
 
-            normalWorld = glm::normalize(normalWorld);
-            glm::vec3 reflectedDirection = ray.direction - 2.0f * glm::dot(ray.direction, normalWorld) * normalWorld;
+// The mirror reflection of ray off surface.
+Ray RayTracer::reflectionRay(const Ray &ray, const SurfacePoint &surface) const {
 
-            reflectedRay.origin = hitPointWorld + normalWorld * 0.001f;
-            reflectedRay.direction = reflectedDirection;
-            reflectedRay.unnormalizedDirection = reflectedDirection;
+    Ray reflectedRay;
 
-            glm::vec4 reflectedColor = raytrace(reflectedRay, scene, recursiveDepth + 1);
-            glm::vec3 reflWeight = glm::vec3(material.cReflective) * scene.getGlobalData().ks;
+    glm::vec3 normalWorld = glm::normalize(surface.normal);
+    glm::vec3 reflectedDirection = ray.direction - 2.0f * glm::dot(ray.direction, normalWorld) * normalWorld;
 
-            color += glm::vec4(reflWeight * glm::vec3(reflectedColor), 0.0f);
+    reflectedRay.origin = surface.position + normalWorld * 0.001f;
+    reflectedRay.direction = reflectedDirection;
+    reflectedRay.unnormalizedDirection = reflectedDirection;
 
-       }
+    return reflectedRay;
+
+}
+
+// Fills spawned with the rays leaving surface after ray hit it, and the weights of their colors, returning how many
+// there are. Reflective materials reflect ks * cReflective of the light. Transparent ones transmit kt * cTransparent,
+// split between the refracted and the reflected ray by Schlick's approximation of the Fresnel term; all of it is
+// reflected past the critical angle.
+int RayTracer::spawnRays(const Ray &ray,
+                         const SurfacePoint &surface,
+                         const SceneMaterial &material,
+                         const RayTraceScene &scene,
+                         SpawnedRay *spawned) const {
+
+    glm::vec3 reflectionWeight(0.0f);
+    int count = 0;
+
+    if (isReflective(material)) reflectionWeight = glm::vec3(material.cReflective) * scene.getGlobalData().ks;
+
+    // Refractive Ray Handling --
+    glm::vec3 transmission = glm::vec3(material.cTransparent) * scene.getGlobalData().kt;
+
+    if (m_config.enableRefraction && glm::compMax(transmission) > 0.0f) {
+
+        glm::vec3 normal = glm::normalize(surface.normal);
+        float ior = (material.ior > 0.0f) ? material.ior : 1.0f;
+
+        // Ratio of the indices on the ray's side and the far side; a ray that hit the inside of a shape is leaving it.
+        float eta = surface.frontFace ? 1.0f / ior : ior;
+        float cosIncident = glm::min(-glm::dot(ray.direction, normal), 1.0f);
+        float sinTransmitted2 = eta * eta * (1.0f - cosIncident * cosIncident);
+
+        float fresnel = 1.0f;
+
+        if (sinTransmitted2 < 1.0f) {
+
+            float cosTransmitted = glm::sqrt(1.0f - sinTransmitted2);
+
+            // Schlick's approximation takes the angle on the side with the lower index.
+            float r0 = (1.0f - eta) / (1.0f + eta);
+            r0 = r0 * r0;
+            float cosine = (eta > 1.0f) ? cosTransmitted : cosIncident;
+            fresnel = r0 + (1.0f - r0) * std::pow(1.0f - cosine, 5.0f);
+
+            glm::vec3 refractedDirection = glm::normalize(eta * ray.direction + (eta * cosIncident - cosTransmitted) * normal);
+
+            Ray refractedRay;
+            refractedRay.origin = surface.position - normal * 0.001f;
+            refractedRay.direction = refractedDirection;
+            refractedRay.unnormalizedDirection = refractedDirection;
+
+            spawned[count++] = SpawnedRay{refractedRay, transmission * (1.0f - fresnel)};
+
+        }
+
+        reflectionWeight += transmission * fresnel;
 
     }
 
-    return color;
+    if (glm::compMax(reflectionWeight) > 0.0f) spawned[count++] = SpawnedRay{reflectionRay(ray, surface), reflectionWeight};
+
+    return count;
 
 }
 
 // Should compute mipmapping and return
-glm::vec4 RayTracer::texture(Texture texture,
+glm::vec4 RayTracer::texture(const Texture &texture,
                   std::tuple<glm::vec3, glm::vec3> differentials,
-                  glm::vec3 hitPoint,
+                  const ShapeHit &hit,
                   glm::vec3 dp_dx,
                   glm::vec3 dp_dy,
-                  std::shared_ptr<Shape> &shape) {
+                  const std::shared_ptr<Shape> &shape,
+                  const glm::mat4 &inverseCTM) {
 
-    glm::vec2 uv = shape->computeUV(hitPoint);
+    glm::vec3 hitPoint = hit.hitPointObject;
+    glm::vec2 uv = shape->computeUV(hitPoint, hit.face, hit.barycentric);
 
-    glm::vec3 dp_dxTexture = glm::vec3(shape->inverseCTM * glm::vec4(dp_dx, 0.0f));
-    glm::vec3 dp_dyTexture = glm::vec3(shape->inverseCTM * glm::vec4(dp_dy, 0.0f));
-    auto textureInfo = shape->texture.info;
+    glm::vec3 dp_dxTexture = glm::vec3(inverseCTM * glm::vec4(dp_dx, 0.0f));
+    glm::vec3 dp_dyTexture = glm::vec3(inverseCTM * glm::vec4(dp_dy, 0.0f));
+    const SceneFileMap &textureInfo = texture.info;
 
     float ds_du, dt_dv;
     float ds_dx, ds_dy;
@@ -388,6 +1110,9 @@ glm::vec4 RayTracer::texture(Texture texture,
     float S = glm::max(X, Y);
     float L = glm::log2(S);
 
+    // A degenerate footprint (e.g. at a sphere's pole) has no meaningful level; sample the finest one.
+    if (!std::isfinite(L)) L = 0.0f;
+
     glm::vec4 color;
 
     switch (m_config.textureFilterType) {
@@ -414,7 +1139,7 @@ glm::vec4 RayTracer::phong(glm::vec3  position,
            glm::vec3  normal,
            glm::vec3  directionToCamera,
            const RayTraceScene& scene,
-           std::shared_ptr<Shape>  &shape,
+           const std::shared_ptr<Shape>  &shape,
            const std::vector<SceneLightData> &lights,
            glm::vec4 textureColor) {
 
@@ -423,106 +1148,113 @@ glm::vec4 RayTracer::phong(glm::vec3  position,
     directionToCamera = glm::normalize(directionToCamera);
 
     SceneMaterial material = shape->shapeInfo.primitive.material;
-    glm::vec3 lightDirection;
     glm::vec4 illumination(0, 0, 0, 1);
 
     // Ambience --
     glm::vec4 ambience = scene.getGlobalData().ka * material.cAmbient;
     illumination += ambience;
 
-    for (const SceneLightData &light : lights) {
-
-        glm::vec4 diffuse, specular;
-        float attenuation = 1.0f;
-        float falloff = 1.0f;
+    for (int lightIndex = 0; lightIndex < (int)lights.size(); lightIndex++) {
 
         // Shadow Ray Checking --
-        if (traceShadowRay(position, scene, light, normal)) {
-
-            if (light.type == LightType::LIGHT_DIRECTIONAL) {
-
-                // Directional Light Calculations --
-                attenuation = 1.0f;
-                falloff = 1.0f;
-                lightDirection = glm::normalize(-glm::vec3(light.dir));
+        if (traceShadowRay(position, scene, lights[lightIndex], lightIndex, normal, m_config.enableAcceleration)) {
+            illumination += lightContribution(position, normal, directionToCamera, scene, material, lights[lightIndex], textureColor);
+        }
 
-            } else {
+    }
 
-                // Should be doing attenuation calculations if the light is not directional .
-                float distance = glm::length(glm::vec3(light.pos) - position);
-                attenuation = 1.0f / (light.function.x +
-                                      distance * light.function.y +
-                                      (distance * distance) * light.function.z);
-                attenuation = glm::min(1.0f, attenuation);
+    return illumination;
 
-                lightDirection = glm::normalize((glm::vec3(light.pos) - position));
+}
 
-                if (light.type == LightType::LIGHT_POINT) {
+// The diffuse and specular light that light adds at position when nothing blocks it. normal and
+// directionToCamera are normalized.
+glm::vec4 RayTracer::lightContribution(glm::vec3  position,
+                                       glm::vec3  normal,
+                                       glm::vec3  directionToCamera,
+                                       const RayTraceScene& scene,
+                                       const SceneMaterial &material,
+                                       const SceneLightData &light,
+                                       glm::vec4 textureColor) const {
 
-                    // Point Light Calculations --
-                    falloff = 1.0f;
+    glm::vec3 lightDirection;
+    glm::vec4 diffuse, specular;
+    float attenuation = 1.0f;
+    float falloff = 1.0f;
 
-                } else {
+    if (light.type == LightType::LIGHT_DIRECTIONAL) {
 
-                    // Spotlight Calculations --
+        // Directional Light Calculations --
+        attenuation = 1.0f;
+        falloff = 1.0f;
+        lightDirection = glm::normalize(-glm::vec3(light.dir));
 
-                    float innerAngle = light.angle - light.penumbra;
-                    glm::vec3 lightToPoint = glm::normalize(position - glm::vec3(light.pos));
-                    float x = glm::acos(glm::dot(glm::normalize(glm::vec3(light.dir)), lightToPoint));
+    } else {
 
-                    if (x <= innerAngle) {
+        // Should be doing attenuation calculations if the light is not directional .
+        float distance = glm::length(glm::vec3(light.pos) - position);
+        attenuation = 1.0f / (light.function.x +
+                              distance * light.function.y +
+                              (distance * distance) * light.function.z);
+        attenuation = glm::min(1.0f, attenuation);
 
-                        falloff = 1.0f;
+        lightDirection = glm::normalize((glm::vec3(light.pos) - position));
 
-                    } else if (x <= light.angle) {
+        if (light.type == LightType::LIGHT_POINT) {
 
-                        float a = (x - innerAngle) / (light.angle - innerAngle);
-                        falloff = 1.0f - (-2.0f * (a * a * a) + 3.0f * (a * a));
+            // Point Light Calculations --
+            falloff = 1.0f;
 
-                    } else {
+        } else {
 
-                        falloff = 0.0f;
+            // Spotlight Calculations --
 
-                    }
+            float innerAngle = light.angle - light.penumbra;
+            glm::vec3 lightToPoint = glm::normalize(position - glm::vec3(light.pos));
+            float x = glm::acos(glm::dot(glm::normalize(glm::vec3(light.dir)), lightToPoint));
 
-                }
+            if (x <= innerAngle) {
 
-            }
-
-            float ndotl = glm::max(glm::dot(normal, lightDirection), 0.0f);
+                falloff = 1.0f;
 
-            // Diffusion Calculations (including UV mapping) --
-            if (material.textureMap.isUsed) {
+            } else if (x <= light.angle) {
 
-                diffuse = (shape->texture.blend * textureColor + (((1.0f - shape->texture.blend) *
-                                                                   scene.getGlobalData().kd * material.cDiffuse))) * ndotl;
+                float a = (x - innerAngle) / (light.angle - innerAngle);
+                falloff = 1.0f - (-2.0f * (a * a * a) + 3.0f * (a * a));
 
             } else {
 
-                // Normal diffuse assignment
-                diffuse = scene.getGlobalData().kd * material.cDiffuse * ndotl;
+                falloff = 0.0f;
 
             }
 
+        }
 
-            // Specular Calculations --
-            glm::vec3 projection = glm::reflect(-lightDirection, normal);
-            float dotVal = glm::dot(projection, directionToCamera);
-            float specPower = std::pow(glm::max(dotVal, 0.0f), material.shininess);
-            specular = scene.getGlobalData().ks * material.cSpecular * specPower;
+    }
 
-            illumination += (attenuation * light.color * falloff) * (diffuse + specular);
+    float ndotl = glm::max(glm::dot(normal, lightDirection), 0.0f);
 
+    // Diffusion Calculations (including UV mapping) --
+    if (material.textureMap.isUsed) {
 
-        } else {
+        diffuse = (material.blend * textureColor + (((1.0f - material.blend) *
+                                                           scene.getGlobalData().kd * material.cDiffuse))) * ndotl;
 
-            continue;
+    } else {
 
-        }
+        // Normal diffuse assignment
+        diffuse = scene.getGlobalData().kd * material.cDiffuse * ndotl;
 
     }
 
-    return illumination;
+
+    // Specular Calculations --
+    glm::vec3 projection = glm::reflect(-lightDirection, normal);
+    float dotVal = glm::dot(projection, directionToCamera);
+    float specPower = std::pow(glm::max(dotVal, 0.0f), material.shininess);
+    specular = scene.getGlobalData().ks * material.cSpecular * specPower;
+
+    return (attenuation * light.color * falloff) * (diffuse + specular);
 
 }
 
@@ -1,8 +1,14 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <mutex>
 #include <glm/glm.hpp>
 #include "camera/camera.h"
+#include "sampler.h"
+#include "shapearrays.h"
 #include "shapes/shape.h"
+#include "tilescheduler.h"
 #include "textures/texture.h"
 #include "utils/ini_utils.h"
 #include "utils/rgba.h"
@@ -10,6 +16,13 @@
 
 #define RAY_TRACE_MAX_DEPTH 4
 #define RAY_TRACE_DEFAULT_SPP 64
+#define RAY_TRACE_TILE_SIZE 16
+#define RAY_TRACE_PROGRESSIVE_FACTOR 4
+#define RAY_TRACE_ADAPTIVE_BATCH 4
+#define RAY_TRACE_ADAPTIVE_THRESHOLD 0.005f
+#define RAY_TRACE_MIN_THROUGHPUT 0.0f
+#define RAY_TRACE_ROULETTE_THRESHOLD 0.05f
+#define RAY_TRACE_WAVEFRONT_SIZE 4096 // Primary rays per wavefront, which bounds the memory of its queues
 
 // A forward declaration for the RaytraceScene class
 
@@ -27,14 +40,35 @@ public:
         bool enableTextureMap    = false;
         TextureFilterType textureFilterType = TextureFilterType::Nearest;
         bool enableParallelism   = false;
+        int threadCount          = 0; // 0 uses every hardware thread
         bool enableSuperSample   = false;
         bool enableAcceleration  = false;
+        bool enablePacketTracing = true; // Trace primary rays RAY_PACKET_WIDTH at a time
+        bool enableWavefront     = false; // Trace rays a generation at a time through queues (see traceWavefront)
+        bool enableRayBinning    = false; // Wavefront mode: sort secondary rays by RayBinning bin before tracing them
         bool enableDepthOfField  = false;
+        bool enableProgressive   = false;
+        int timeBudgetMs         = 0; // Progressive mode stops after the pass that runs past this, 0 for no limit
         int maxRecursiveDepth    = RAY_TRACE_MAX_DEPTH;
+        float minThroughput      = RAY_TRACE_MIN_THROUGHPUT; // Secondary rays adding less than this to their pixel are not traced, 0 traces all
+        bool enableRussianRoulette = false; // Instead of minThroughput, end paths below rouletteThreshold at random (see continuePath)
+        float rouletteThreshold  = RAY_TRACE_ROULETTE_THRESHOLD;
         int samplesPerPixel      = RAY_TRACE_DEFAULT_SPP;
         SuperSamplerPattern superSamplerPattern = SuperSamplerPattern::Grid;
+        std::uint32_t seed       = 0; // Frame seed for Random/Stratified/Adaptive sampling
+        float adaptiveThreshold  = RAY_TRACE_ADAPTIVE_THRESHOLD; // Standard error of a pixel's luminance at which Adaptive stops
         bool onlyRenderNormals   = false;
         bool enableMipMapping    = false;
+        ToneMapOperator toneMap  = ToneMapOperator::Clamp; // How 8-bit output compresses colors above 1
+        float exposure           = 0.0f; // Stops of exposure applied before toneMap, for 8-bit output only
+    };
+
+    // Totals over the secondary rays binned by this ray-tracer so far, in packets of RAY_PACKET_WIDTH rays.
+    struct BinningStats {
+        std::uint64_t rays = 0;
+        std::uint64_t packets = 0;
+        std::uint64_t binsBefore = 0; // Distinct bins in each packet, summed, with the rays in the order they were spawned
+        std::uint64_t binsAfter = 0;  // The same once sorted
     };
 
 public:
@@ -46,31 +80,139 @@ public:
     // @param scene The scene to be rendered.
     void render(RGBA *imageData, const RayTraceScene &scene);
 
+    // Same as above, but keeps the linear, unclamped color of every pixel (alpha 1) for HDR output.
+    // Exposure and tone mapping are left to whoever views the image.
+    void render(glm::vec4 *imageData, const RayTraceScene &scene);
+
+    // Renders the scene in passes of 1, 4, 16, ... samples per pixel, up to the configured count.
+    // Samples accumulate across passes, and imageData holds the current estimate after each one.
+    // Every pixel gets the same samples per pass, so the Adaptive pattern renders like Stratified here.
+    // @param onPass Called after every pass with the samples per pixel so far, e.g. to save a preview.
+    void renderProgressive(RGBA *imageData, const RayTraceScene &scene, const std::function<void(int)> &onPass);
+    void renderProgressive(glm::vec4 *imageData, const RayTraceScene &scene, const std::function<void(int)> &onPass);
+
+    BinningStats binningStats() const;
+
 private:
 
+    // Times private stages such as phong() in isolation.
+    friend class RayTracerBenchmark;
+
     const Config m_config;
+    const Sampler m_sampler;
     int spp;
     int spp_sqrt;
+    int sampleStride;
+    std::tuple<glm::vec3, glm::vec3> r_bar; // Camera::calculateR(spp) of the current render
+
+    mutable std::mutex m_binningMutex;
+    BinningStats m_binningStats;
+
+    // What shading needs to know about a hit, in world space. normal faces the ray but is not normalized.
+    struct SurfacePoint {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec4 textureColor = glm::vec4(0.0f);
+        bool frontFace = true; // Whether the ray hit the outside of the shape
+    };
+
+    // A reflected or refracted ray, and the weight its color adds to the color of the ray that spawned it.
+    struct SpawnedRay {
+        Ray ray;
+        glm::vec3 weight;
+    };
+
+    // One generation of rays in wavefront mode. Ray k adds weights[k] times its color to colors[pixels[k]].
+    struct RayQueue {
+        std::vector<Ray> rays;
+        std::vector<int> pixels;
+        std::vector<glm::vec3> weights;
+    };
+
+    // Receives the finished colors of pixels [x0, x1) of row j, to store them in whatever form the output takes.
+    using SpanOutput = std::function<void(int x0, int x1, int j, const glm::vec4 *colors)>;
+
+    void renderSpans(const RayTraceScene &scene, const SpanOutput &output);
+
+    void renderProgressiveSpans(const RayTraceScene &scene, const SpanOutput &output, const std::function<void(int)> &onPass);
+
+    RGBA toRGBA(const glm::vec4 &illumination) const;
+
+    void setupSampling(const RayTraceScene &scene, bool progressive);
+
+    void forEachTile(const RayTraceScene &scene, const std::function<void(const Tile &)> &renderTile);
+
+    void forEachSpan(const RayTraceScene &scene, const std::function<void(int, int, int)> &span);
+
+    Ray primaryRay(int i, int j, int sample, const RayTraceScene &scene) const;
+
+    glm::vec2 lensSample(std::uint32_t pixelIndex, int sample) const;
+
+    void traceSpan(int x0, int x1, int j, int sampleBegin, int sampleEnd, glm::vec4 *colors, const RayTraceScene &scene);
+
+    void traceSpanAdaptive(int x0, int x1, int j, glm::vec4 *colors, const RayTraceScene &scene);
+
+    void traceRays(const Ray *rays, int count, const RayTraceScene &scene, glm::vec4 *colors);
+
+    void traceTileWavefront(const Tile &tile, int sampleBegin, int sampleEnd, glm::vec4 *colors, int stride, const RayTraceScene &scene);
+
+    void traceWavefront(RayQueue &queue, const RayTraceScene &scene, glm::vec4 *colors);
+
+    void binRays(RayQueue &queue, const RayTraceScene &scene);
+
+    void intersectRays(const Ray *rays, int count, const RayTraceScene &scene, ShapeHit *hits);
 
     glm::vec4 raytrace(Ray ray,
                   const RayTraceScene &scene,
-                  int recursiveDepth);
+                  int recursiveDepth,
+                  glm::vec3 throughput); // How much of the color reaches the pixel
+
+    void raytracePacket(const Ray *rays,
+                        int count,
+                        const RayTraceScene &scene,
+                        glm::vec4 *colors);
+
+    glm::vec4 shade(const Ray &ray,
+                    const ShapeHit &hit,
+                    const RayTraceScene &scene,
+                    int recursiveDepth,
+                    glm::vec3 throughput);
+
+    bool continuePath(SpawnedRay &spawned, glm::vec3 throughput, int depth) const;
+
+    SurfacePoint surfacePoint(const Ray &ray, const ShapeHit &hit, const RayTraceScene &scene);
 
-    // Change to type Texture
-    glm::vec4 texture(Texture texture,
+    Ray reflectionRay(const Ray &ray, const SurfacePoint &surface) const;
+
+    int spawnRays(const Ray &ray,
+                  const SurfacePoint &surface,
+                  const SceneMaterial &material,
+                  const RayTraceScene &scene,
+                  SpawnedRay *spawned) const;
+
+    glm::vec4 texture(const Texture &texture,
                       std::tuple<glm::vec3, glm::vec3> differentials,
-                      glm::vec3 hitPoint,
+                      const ShapeHit &hit,
                       glm::vec3 dp_dx,
                       glm::vec3 dp_dy,
-                      std::shared_ptr<Shape>  &shape);
+                      const std::shared_ptr<Shape>  &shape,
+                      const glm::mat4 &inverseCTM); // World to object space, including the shape's instance
 
     glm::vec4 phong(glm::vec3  position,
                glm::vec3  normal,
                glm::vec3  directionToCamera,
                const RayTraceScene& scene,
-               std::shared_ptr<Shape>  &material,
+               const std::shared_ptr<Shape>  &material,
                const std::vector<SceneLightData> &lights,
                glm::vec4 textureColor);
 
+    glm::vec4 lightContribution(glm::vec3  position,
+                                glm::vec3  normal,
+                                glm::vec3  directionToCamera,
+                                const RayTraceScene& scene,
+                                const SceneMaterial &material,
+                                const SceneLightData &light,
+                                glm::vec4 textureColor) const;
+
 };
 
@@ -6,10 +6,10 @@
 #include "shapes/cone.h"
 #include "shapes/cube.h"
 #include "shapes/cylinder.h"
+#include "shapes/mesh.h"
 #include "shapes/sphere.h"
-#include "utils/imagereader.h"
 
-RayTraceScene::RayTraceScene(int width, int height, const RenderData &metaData) {
+RayTraceScene::RayTraceScene(int width, int height, const RenderData &metaData, int loadThreadCount) {
     // Optional TODO: implement this. Store whatever you feel is necessary.
     m_width = width;
     m_height = height;
@@ -18,11 +18,179 @@ RayTraceScene::RayTraceScene(int width, int height, const RenderData &metaData)
     SceneCameraData camera = metaData.cameraData;
     cam.init(camera, width, height);
 
+    animation = metaData.animation;
+    cameraData = camera;
+    lightAnimation = metaData.lightAnimation;
+
     lights = metaData.lights;
-    shapes = parseRenderShapeData(metaData.shapes);
+    shapes = parseRenderShapeData(metaData.shapes, loadThreadCount);
+    placedShapeCount = (int)shapes.size();
+    shapeArrays.build(shapes);
+
+    // Templates --
+    // Their shapes are created once, after the shapes placed directly, and shared by every instance.
+    for (const RenderTemplateData &templateData : metaData.templates) {
+        std::vector<std::shared_ptr<Shape>> templateShapes = parseRenderShapeData(templateData.shapes, loadThreadCount);
+        instanceArrays.addTemplate(templateShapes, (int)shapes.size());
+        shapes.insert(shapes.end(), templateShapes.begin(), templateShapes.end());
+    }
+
+    for (const RenderInstanceData &instance : metaData.instances) {
+        instanceArrays.addInstance(instance.templateIndex, instance.ctm);
+        instanceAnimation.push_back(instance.animation);
+    }
+
+    // Acceleration structure over the world space bounds of every shape placed directly and every instance.
+    for (int index = 0; index < placedShapeCount; index++) {
+        primitiveBounds.push_back(shapeArrays.worldBounds(index));
+    }
+    for (int instance = 0; instance < instanceArrays.size(); instance++) {
+        primitiveBounds.push_back(instanceArrays.worldBounds(instance));
+    }
+    bvh.build(primitiveBounds);
 }
 
-std::vector<std::shared_ptr<Shape>> RayTraceScene::parseRenderShapeData(std::vector<RenderShapeData> shapeList) {
+int RayTraceScene::frameCount() const {
+    return animation.frameCount;
+}
+
+void RayTraceScene::setFrame(float frame) {
+
+    if (!animation.camera.empty()) cam.init(Animation::camera(animation, cameraData, frame), m_width, m_height);
+
+    for (int index = 0; index < (int)lights.size(); index++) {
+
+        const RenderLightAnimation &light = lightAnimation[index];
+        if (!light.path.isAnimated()) continue;
+
+        glm::mat4 ctm = light.path.ctm(animation, frame);
+        lights[index].pos = ctm * glm::vec4(0, 0, 0, 1);
+        lights[index].dir = ctm * light.dir;
+
+    }
+
+    std::vector<int> moved;
+
+    for (int index = 0; index < placedShapeCount; index++) {
+
+        Shape &shape = *shapes[index];
+        if (!shape.shapeInfo.animation.isAnimated()) continue;
+
+        shape.shapeInfo.ctm = shape.shapeInfo.animation.ctm(animation, frame);
+        shape.inverseCTM = glm::inverse(shape.shapeInfo.ctm);
+        moved.push_back(index);
+
+    }
+
+    std::vector<int> movedInstances;
+
+    for (int instance = 0; instance < instanceArrays.size(); instance++) {
+
+        if (!instanceAnimation[instance].isAnimated()) continue;
+
+        instanceArrays.setTransform(instance, instanceAnimation[instance].ctm(animation, frame));
+        movedInstances.push_back(instance);
+
+    }
+
+    if (!moved.empty() || !movedInstances.empty()) moveShapes(moved, movedInstances);
+
+}
+
+void RayTraceScene::setShapeTransform(int shapeIndex, const glm::mat4 &ctm) {
+
+    Shape &shape = *shapes[shapeIndex];
+    shape.shapeInfo.ctm = ctm;
+    shape.inverseCTM = glm::inverse(ctm);
+
+    moveShapes({shapeIndex}, {});
+
+}
+
+void RayTraceScene::setInstanceTransform(int instance, const glm::mat4 &ctm) {
+
+    instanceArrays.setTransform(instance, ctm);
+    moveShapes({}, {instance});
+
+}
+
+void RayTraceScene::moveShapes(const std::vector<int> &shapeIndices, const std::vector<int> &instances) {
+
+    shapeArrays.update(shapes, shapeIndices);
+
+    std::vector<int> changed = shapeIndices;
+    for (int index : shapeIndices) primitiveBounds[index] = shapeArrays.worldBounds(index);
+
+    for (int instance : instances) {
+        primitiveBounds[placedShapeCount + instance] = instanceArrays.worldBounds(instance);
+        changed.push_back(placedShapeCount + instance);
+    }
+
+    bvh.refit(primitiveBounds, changed);
+
+}
+
+void RayTraceScene::intersect(int index, const Ray &ray, ShapeHit &hit) const {
+
+    if (index < placedShapeCount) shapeArrays.intersect(index, ray, hit);
+    else instanceArrays.intersect(index - placedShapeCount, ray, hit);
+
+}
+
+void RayTraceScene::intersect(int index, const RayPacket &packet, PacketHit &hit) const {
+
+    if (index < placedShapeCount) shapeArrays.intersect(index, packet, hit);
+    else instanceArrays.intersect(index - placedShapeCount, packet, hit);
+
+}
+
+bool RayTraceScene::occluded(int index, const Ray &ray, float tMax) const {
+
+    if (index < placedShapeCount) return shapeArrays.occluded(index, ray, tMax);
+    return instanceArrays.occluded(index - placedShapeCount, ray, tMax);
+
+}
+
+void RayTraceScene::intersectAll(const Ray &ray, ShapeHit &hit) const {
+
+    shapeArrays.intersectAll(ray, hit);
+    instanceArrays.intersectAll(ray, hit);
+
+}
+
+void RayTraceScene::intersectAll(const RayPacket &packet, PacketHit &hit) const {
+
+    shapeArrays.intersectAll(packet, hit);
+    instanceArrays.intersectAll(packet, hit);
+
+}
+
+int RayTraceScene::findOccluder(const Ray &ray, float tMax, int skipIndex) const {
+
+    int occluder = shapeArrays.findOccluder(ray, tMax, skipIndex);
+    if (occluder >= 0) return occluder;
+
+    int instance = instanceArrays.findOccluder(ray, tMax, skipIndex - placedShapeCount);
+    return (instance >= 0) ? placedShapeCount + instance : -1;
+
+}
+
+int RayTraceScene::primitiveCount() const {
+    return placedShapeCount + instanceArrays.size();
+}
+
+// Shares the shape's texture with every other shape using the same file and repeat settings.
+// A texture that fails to load leaves the shape untextured.
+static void loadTexture(Shape &shape, int threadCount) {
+
+    SceneMaterial &material = shape.shapeInfo.primitive.material;
+
+    shape.texture = Texture::load(material.textureMap, threadCount);
+    if (!shape.texture) material.textureMap.isUsed = false;
+
+}
+
+std::vector<std::shared_ptr<Shape>> RayTraceScene::parseRenderShapeData(std::vector<RenderShapeData> shapeList, int loadThreadCount) {
 
     std::vector<std::shared_ptr<Shape>> shapes = std::vector<std::shared_ptr<Shape>>();
 
@@ -37,15 +205,7 @@ std::vector<std::shared_ptr<Shape>> RayTraceScene::parseRenderShapeData(std::vec
                 cube->inverseCTM = glm::inverse(shapeData.ctm);
 
                 if (cube->shapeInfo.primitive.material.textureMap.isUsed) {
-
-                    Image* txt = loadImageFromFile(cube->shapeInfo.primitive.material.textureMap.filename);
-                    SceneFileMap data = cube->shapeInfo.primitive.material.textureMap;
-                    float blend = cube->shapeInfo.primitive.material.blend;
-
-                    Texture t = Texture(txt, data, blend);
-                    cube->texture = t;
-                    cube->texture.generateMaps();
-
+                    loadTexture(*cube, loadThreadCount);
                 }
 
                 shapes.push_back(cube);
@@ -60,15 +220,7 @@ std::vector<std::shared_ptr<Shape>> RayTraceScene::parseRenderShapeData(std::vec
                 cone->inverseCTM = glm::inverse(shapeData.ctm);
 
                 if (cone->shapeInfo.primitive.material.textureMap.isUsed) {
-
-                    Image* txt = loadImageFromFile(cone->shapeInfo.primitive.material.textureMap.filename);
-                    SceneFileMap data = cone->shapeInfo.primitive.material.textureMap;
-                    float blend = cone->shapeInfo.primitive.material.blend;
-
-                    Texture t = Texture(txt, data, blend);
-                    cone->texture = t;
-                    cone->texture.generateMaps();
-
+                    loadTexture(*cone, loadThreadCount);
                 }
 
                 shapes.push_back(cone);
@@ -83,15 +235,7 @@ std::vector<std::shared_ptr<Shape>> RayTraceScene::parseRenderShapeData(std::vec
                 cyl->inverseCTM = glm::inverse(shapeData.ctm);
 
                 if (cyl->shapeInfo.primitive.material.textureMap.isUsed) {
-
-                    Image* txt = loadImageFromFile(cyl->shapeInfo.primitive.material.textureMap.filename);
-                    SceneFileMap data = cyl->shapeInfo.primitive.material.textureMap;
-                    float blend = cyl->shapeInfo.primitive.material.blend;
-
-                    Texture t = Texture(txt, data, blend);
-                    cyl->texture = t;
-                    cyl->texture.generateMaps();
-
+                    loadTexture(*cyl, loadThreadCount);
                 }
 
                 shapes.push_back(cyl);
@@ -106,15 +250,7 @@ std::vector<std::shared_ptr<Shape>> RayTraceScene::parseRenderShapeData(std::vec
                 sphere->inverseCTM = glm::inverse(shapeData.ctm);
 
                 if (sphere->shapeInfo.primitive.material.textureMap.isUsed) {
-
-                    Image* txt = loadImageFromFile(sphere->shapeInfo.primitive.material.textureMap.filename);
-                    SceneFileMap data = sphere->shapeInfo.primitive.material.textureMap;
-                    float blend = sphere->shapeInfo.primitive.material.blend;
-
-                    Texture t = Texture(txt, data, blend);
-                    sphere->texture = t;
-                    sphere->texture.generateMaps();
-
+                    loadTexture(*sphere, loadThreadCount);
                 }
 
                 shapes.push_back(sphere);
@@ -122,8 +258,24 @@ std::vector<std::shared_ptr<Shape>> RayTraceScene::parseRenderShapeData(std::vec
 
             }
 
-            case PrimitiveType::PRIMITIVE_MESH:
+            case PrimitiveType::PRIMITIVE_MESH: {
+
+                // Instances of the same file share its triangles and their BVH.
+                std::shared_ptr<const TriangleMesh> triangles = TriangleMesh::load(shapeData.primitive.meshfile);
+                if (!triangles) break;
+
+                std::shared_ptr<Shape> mesh  = std::make_shared<Mesh>(triangles);
+                mesh->shapeInfo = shapeData;
+                mesh->inverseCTM = glm::inverse(shapeData.ctm);
+
+                if (mesh->shapeInfo.primitive.material.textureMap.isUsed) {
+                    loadTexture(*mesh, loadThreadCount);
+                }
+
+                shapes.push_back(mesh);
                 break;
+
+            }
             }
 
     }
@@ -148,6 +300,18 @@ const Camera& RayTraceScene::getCamera() const {
     return cam;
 }
 
+const ShapeArrays& RayTraceScene::getShapeArrays() const {
+    return shapeArrays;
+}
+
+const InstanceArrays& RayTraceScene::getInstanceArrays() const {
+    return instanceArrays;
+}
+
+const BVH& RayTraceScene::getBVH() const {
+    return bvh;
+}
+
 const std::vector<SceneLightData>& RayTraceScene::getLightData() const {
     return lights;
 }
@@ -4,6 +4,9 @@
 #include "utils/sceneparser.h"
 #include "camera/camera.h"
 #include "shapes/shape.h"
+#include "bvh.h"
+#include "instancearrays.h"
+#include "shapearrays.h"
 #include <functional>
 
 // A class representing a scene to be ray-traced
@@ -30,10 +33,23 @@ private:
     int m_height;
 
     std::vector<SceneLightData> lights;
-    std::vector<std::shared_ptr<Shape>> shapes;
+    std::vector<std::shared_ptr<Shape>> shapes; // The shapes placed directly, then the shapes of every template
+    int placedShapeCount;
+    ShapeArrays shapeArrays;                    // Over the shapes placed directly
+    InstanceArrays instanceArrays;
+    std::vector<AABB> primitiveBounds;          // World space bounds of the BVH's primitives (see intersect())
+    BVH bvh;
+
+    // Kept to move the camera, shapes and lights between frames
+    SceneAnimation animation;
+    SceneCameraData cameraData;
+    std::vector<RenderLightAnimation> lightAnimation;
+    std::vector<AnimationPath> instanceAnimation;
 
 public:
-    RayTraceScene(int width, int height, const RenderData &metaData);
+    // loadThreadCount bounds the threads that build the mip chains of the scene's textures; 0 uses every
+    // hardware thread.
+    RayTraceScene(int width, int height, const RenderData &metaData, int loadThreadCount = 0);
 
     // The getter of the width of the scene
     const int& width() const;
@@ -47,11 +63,54 @@ public:
     // The getter of light data of the scene
     const std::vector<SceneLightData>& getLightData() const;
 
-    // The getter of the shape data scene
+    // The getter of the shape data scene. Shapes of templates are in the template's space; a hit through an
+    // instance (ShapeHit::instance) is placed by getInstanceArrays().ctm(instance) * shape->shapeInfo.ctm.
     const std::vector<std::shared_ptr<Shape>>& getShapeData() const;
 
     // The getter of the shared pointer to the camera instance of the scene
     const Camera& getCamera() const;
 
-    std::vector<std::shared_ptr<Shape>> parseRenderShapeData(std::vector<RenderShapeData> shapeList);
+    // The getter of the flat, per-type arrays of the shapes placed directly, used by the intersection loops
+    const ShapeArrays& getShapeArrays() const;
+
+    // The getter of the templates and their instances
+    const InstanceArrays& getInstanceArrays() const;
+
+    // The getter of the bounding volume hierarchy over the world space bounds of the shapes placed directly,
+    // followed by those of the instances
+    const BVH& getBVH() const;
+
+    // Queries on primitive index of getBVH(), which is a shape placed directly or, past those, an instance.
+    void intersect(int index, const Ray &ray, ShapeHit &hit) const;
+    void intersect(int index, const RayPacket &packet, PacketHit &hit) const;
+    bool occluded(int index, const Ray &ray, float tMax) const;
+
+    // The same without the BVH, testing every shape and instance. findOccluder returns a primitive index of getBVH().
+    void intersectAll(const Ray &ray, ShapeHit &hit) const;
+    void intersectAll(const RayPacket &packet, PacketHit &hit) const;
+    int findOccluder(const Ray &ray, float tMax, int skipIndex = -1) const;
+
+    // The number of primitives of getBVH()
+    int primitiveCount() const;
+
+    std::vector<std::shared_ptr<Shape>> parseRenderShapeData(std::vector<RenderShapeData> shapeList, int loadThreadCount = 0);
+
+    // The number of frames of the scene's animation, 1 for a still scene
+    int frameCount() const;
+
+    // Poses the scene at frame. Only the camera and the CTMs under animated groups are recomputed, and the
+    // acceleration structure is refit around the moved shapes; geometry and textures are left as they are.
+    void setFrame(float frame);
+
+    // Moves one shape placed directly (not part of a template) to a new CTM in place, e.g. while editing. The BVH
+    // is refit along the path above the shape and only rebuilt once moves have degraded it (see BVH::refit).
+    // setFrame() overrides shapes under animated groups.
+    void setShapeTransform(int shapeIndex, const glm::mat4 &ctm);
+
+    // Moves one instance of a template the same way.
+    void setInstanceTransform(int instance, const glm::mat4 &ctm);
+
+private:
+    // Refreshes the packed data, bounds and BVH nodes of shapes and instances whose CTMs changed.
+    void moveShapes(const std::vector<int> &shapeIndices, const std::vector<int> &instances);
 };
@@ -0,0 +1,74 @@
+#include "sampler.h"
+
+Sampler::Sampler(std::uint32_t seed) :
+    m_seed(seed)
+{}
+
+// One round of the PCG RXS-M-XS output permutation (Jarzynski & Olano, "Hash Functions for GPU Rendering").
+std::uint32_t Sampler::pcgHash(std::uint32_t value) {
+
+    std::uint32_t state = value * 747796405u + 2891336453u;
+    std::uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+
+    return (word >> 22u) ^ word;
+
+}
+
+float Sampler::get1D(std::uint32_t pixelIndex, std::uint32_t sampleIndex, SampleDimension dimension) const {
+
+    // Chaining the hash keeps nearby counters (neighbouring pixels, consecutive samples) uncorrelated.
+    std::uint32_t h = pcgHash(m_seed ^ pcgHash(pixelIndex));
+    h = pcgHash(h ^ sampleIndex);
+    h = pcgHash(h ^ static_cast<std::uint32_t>(dimension));
+
+    // The top 24 bits fill a float mantissa exactly, which keeps the result strictly below 1.
+    return (float)(h >> 8) * (1.0f / 16777216.0f);
+
+}
+
+glm::vec2 Sampler::get2D(std::uint32_t pixelIndex, std::uint32_t sampleIndex, SampleDimension dimension) const {
+
+    std::uint32_t next = static_cast<std::uint32_t>(dimension) + 1u;
+
+    return glm::vec2(get1D(pixelIndex, sampleIndex, dimension),
+                     get1D(pixelIndex, sampleIndex, static_cast<SampleDimension>(next)));
+
+}
+
+// Kensler's hashed permutation ("Correlated Multi-Jittered Sampling"). The hash is a bijection on the smallest power
+// of two range covering count, and values past count are hashed again until they land inside it.
+std::uint32_t Sampler::permute(std::uint32_t index, std::uint32_t count, std::uint32_t pixelIndex, SampleDimension dimension) const {
+
+    std::uint32_t p = pcgHash(pcgHash(m_seed ^ pcgHash(pixelIndex)) ^ static_cast<std::uint32_t>(dimension));
+
+    std::uint32_t mask = count - 1;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+
+    do {
+        index ^= p;
+        index *= 0xe170893du;
+        index ^= p >> 16;
+        index ^= (index & mask) >> 4;
+        index ^= p >> 8;
+        index *= 0x0929eb3fu;
+        index ^= p >> 23;
+        index ^= (index & mask) >> 1;
+        index *= 1u | p >> 27;
+        index *= 0x6935fa69u;
+        index ^= (index & mask) >> 11;
+        index *= 0x74dcb303u;
+        index ^= (index & mask) >> 2;
+        index *= 0x9e501cc3u;
+        index ^= (index & mask) >> 2;
+        index *= 0xc860a3dfu;
+        index &= mask;
+        index ^= index >> 5;
+    } while (index >= count);
+
+    return (index + p) % count;
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// The dimensions a sample can be drawn in. Each one gets an independent stream.
+enum class SampleDimension : std::uint32_t {
+    PixelX = 0,
+    PixelY = 1,
+    Roulette = 2, // Keyed by a ray rather than a pixel (see RayTracer::continuePath)
+    LensU = 3,
+    LensV = 4,
+};
+
+// A counter-based random number generator.
+// Every value is a pure function of (seed, pixel index, sample index, dimension), so samples can be
+// drawn on any thread and in any order without shared state, and renders are reproducible across runs.
+
+class Sampler
+{
+public:
+    Sampler(std::uint32_t seed = 0);
+
+    // Returns a uniformly distributed value in [0, 1).
+    float get1D(std::uint32_t pixelIndex, std::uint32_t sampleIndex, SampleDimension dimension) const;
+
+    // Returns two independent values in [0, 1), drawn from dimension and the one after it.
+    glm::vec2 get2D(std::uint32_t pixelIndex, std::uint32_t sampleIndex, SampleDimension dimension) const;
+
+    // Returns where index lands in a random permutation of [0, count), one permutation per pixel and dimension.
+    std::uint32_t permute(std::uint32_t index, std::uint32_t count, std::uint32_t pixelIndex, SampleDimension dimension) const;
+
+private:
+
+    std::uint32_t m_seed;
+
+    static std::uint32_t pcgHash(std::uint32_t value);
+};
@@ -0,0 +1,415 @@
+#include "shapearrays.h"
+#include "shapes/cone.h"
+#include "shapes/cube.h"
+#include "shapes/cylinder.h"
+#include "shapes/mesh.h"
+#include "shapes/sphere.h"
+
+void ShapeArrays::build(const std::vector<std::shared_ptr<Shape>> &shapes) {
+
+    for (Group &group : m_groups) group = Group();
+    m_locations.clear();
+
+    for (int index = 0; index < (int)shapes.size(); index++) {
+
+        const Shape &shape = *shapes[index];
+        Group &group = m_groups[(int)shape.shapeInfo.primitive.type];
+        int slot = (int)group.shapeIndices.size();
+
+        m_locations.push_back(Location{(int)shape.shapeInfo.primitive.type, slot});
+
+        group.inverseCTMs.emplace_back();
+        group.boundingSpheres.emplace_back();
+        group.bounds.emplace_back();
+        group.shapeIndices.push_back(index);
+
+        if (shape.shapeInfo.primitive.type == PrimitiveType::PRIMITIVE_MESH) {
+            group.meshes.push_back(static_cast<const Mesh *>(&shape));
+        }
+
+        place(group, slot, shape);
+
+    }
+
+}
+
+void ShapeArrays::update(const std::vector<std::shared_ptr<Shape>> &shapes, const std::vector<int> &shapeIndices) {
+
+    for (int index : shapeIndices) {
+        const Location &location = m_locations[index];
+        place(m_groups[location.group], location.slot, *shapes[index]);
+    }
+
+}
+
+// Stores the shape's inverse CTM and world space bounding volumes in its slot.
+void ShapeArrays::place(Group &group, int slot, const Shape &shape) {
+
+    const glm::mat4 &ctm = shape.shapeInfo.ctm;
+
+    // Bounding Volumes --
+    AABB objectBounds = shape.objectBounds();
+    glm::vec3 center = glm::vec3(ctm * glm::vec4(objectBounds.centroid(), 1.0f));
+
+    // The transformed object box holds the shape, so its farthest corner bounds the sphere. Scaling the box
+    // diagonal by the longest CTM column is not enough once a non-uniform scale follows a rotation.
+    float radius = 0.0f;
+    for (int corner = 0; corner < 8; corner++) {
+
+        glm::vec3 point((corner & 1) ? objectBounds.max.x : objectBounds.min.x,
+                        (corner & 2) ? objectBounds.max.y : objectBounds.min.y,
+                        (corner & 4) ? objectBounds.max.z : objectBounds.min.z);
+
+        radius = glm::max(radius, glm::length(glm::vec3(ctm * glm::vec4(point, 1.0f)) - center));
+
+    }
+
+    group.inverseCTMs[slot] = shape.inverseCTM;
+    group.boundingSpheres[slot] = glm::vec4(center, radius * 1.001f); // Slack for rounding in mayHit
+    group.bounds[slot] = objectBounds.transformed(ctm);
+
+}
+
+const AABB &ShapeArrays::worldBounds(int shapeIndex) const {
+
+    const Location &location = m_locations[shapeIndex];
+    return m_groups[location.group].bounds[location.slot];
+
+}
+
+// Returns false if the ray certainly misses the primitive's bounds within (0, tMax).
+bool ShapeArrays::mayHit(const Group &group, int slot, const Ray &ray, const glm::vec3 &invDirection, float tMax) {
+
+    // Bounding Sphere --
+    const glm::vec4 &sphere = group.boundingSpheres[slot];
+
+    glm::vec3 toCenter = glm::vec3(sphere) - ray.origin;
+    float tCenter = glm::dot(toCenter, ray.direction);
+
+    if (tCenter + sphere.w < 0.0f || tCenter - sphere.w > tMax) return false;
+    if (glm::dot(toCenter, toCenter) - tCenter * tCenter > sphere.w * sphere.w) return false;
+
+    // Bounding Box --
+    float tNear;
+    return group.bounds[slot].intersect(ray.origin, invDirection, tMax, tNear);
+
+}
+
+template <typename Kernel>
+void ShapeArrays::intersectSlot(const Group &group, int slot, const Ray &ray, const glm::vec3 &invDirection, ShapeHit &hit) {
+
+    if (!mayHit(group, slot, ray, invDirection, hit.t)) return;
+
+    const glm::mat4 &inverseCTM = group.inverseCTMs[slot];
+
+    glm::vec3 originObject    = glm::vec3(inverseCTM * glm::vec4(ray.origin, 1.0f));
+    glm::vec3 directionObject = glm::vec3(inverseCTM * glm::vec4(ray.direction, 0.0f));
+
+    // The ray parameter survives the affine transform, so with a normalized world direction the
+    // object space t already is the world space distance.
+    float t;
+    if (!Kernel::closestHit(Ray {originObject, directionObject}, t)) return;
+
+    if (t < hit.t && t > 1e-6f) {
+
+        hit.t = t;
+        hit.shapeIndex = group.shapeIndices[slot];
+        hit.hitPointObject = originObject + t * directionObject;
+        hit.face = -1;
+        hit.instance = -1;
+
+    }
+
+}
+
+template <typename Kernel>
+void ShapeArrays::intersectSlot(const Group &group, int slot, const RayPacket &packet, PacketHit &hit) {
+
+    // Bounding Sphere --
+    const glm::vec4 &sphere = group.boundingSpheres[slot];
+
+    PacketFloat toCenterX = PacketFloat(sphere.x) - packet.originX;
+    PacketFloat toCenterY = PacketFloat(sphere.y) - packet.originY;
+    PacketFloat toCenterZ = PacketFloat(sphere.z) - packet.originZ;
+    PacketFloat tCenter = toCenterX * packet.directionX + toCenterY * packet.directionY + toCenterZ * packet.directionZ;
+    PacketFloat distance2 = toCenterX * toCenterX + toCenterY * toCenterY + toCenterZ * toCenterZ - tCenter * tCenter;
+
+    PacketFloat radius(sphere.w);
+    PacketMask inSphere = packet.active & !(tCenter + radius < PacketFloat(0.0f)) & !(tCenter - radius > hit.t) &
+                      !(distance2 > radius * radius);
+    if (!inSphere.any()) return;
+
+    RayPacket objectPacket = packet.transformed(group.inverseCTMs[slot]);
+
+    PacketFloat t;
+    PacketMask mask = Kernel::closestHit(objectPacket, t);
+
+    mask = mask & inSphere & (t < hit.t) & (t > PacketFloat(1e-6f));
+    if (!mask.any()) return;
+
+    hit.t = select(mask, t, hit.t);
+
+    PacketFloat hitX = objectPacket.originX + t * objectPacket.directionX;
+    PacketFloat hitY = objectPacket.originY + t * objectPacket.directionY;
+    PacketFloat hitZ = objectPacket.originZ + t * objectPacket.directionZ;
+
+    float lanes[4][RAY_PACKET_WIDTH];
+    t.store(lanes[0]);
+    hitX.store(lanes[1]);
+    hitY.store(lanes[2]);
+    hitZ.store(lanes[3]);
+
+    for (int lane = 0; lane < RAY_PACKET_WIDTH; lane++) {
+
+        if (!mask.lane(lane)) continue;
+
+        hit.lanes[lane].t = lanes[0][lane];
+        hit.lanes[lane].shapeIndex = group.shapeIndices[slot];
+        hit.lanes[lane].hitPointObject = glm::vec3(lanes[1][lane], lanes[2][lane], lanes[3][lane]);
+        hit.lanes[lane].face = -1;
+        hit.lanes[lane].instance = -1;
+
+    }
+
+}
+
+template <typename Kernel>
+bool ShapeArrays::occludedSlot(const Group &group, int slot, const Ray &ray, const glm::vec3 &invDirection, float tMax) {
+
+    if (!mayHit(group, slot, ray, invDirection, tMax)) return false;
+
+    const glm::mat4 &inverseCTM = group.inverseCTMs[slot];
+
+    glm::vec3 originObject    = glm::vec3(inverseCTM * glm::vec4(ray.origin, 1.0f));
+    glm::vec3 directionObject = glm::vec3(inverseCTM * glm::vec4(ray.direction, 0.0f));
+
+    // The ray parameter is preserved by the transform, so tMax still measures world distance.
+    return Kernel::anyHit(Ray {originObject, directionObject}, tMax);
+
+}
+
+// Meshes --
+// Same as the templates above, but a mesh kernel needs the instance's triangles and reports the face it hit.
+
+void ShapeArrays::intersectMeshSlot(const Group &group, int slot, const Ray &ray, const glm::vec3 &invDirection, ShapeHit &hit) {
+
+    if (!mayHit(group, slot, ray, invDirection, hit.t)) return;
+
+    const glm::mat4 &inverseCTM = group.inverseCTMs[slot];
+
+    glm::vec3 originObject    = glm::vec3(inverseCTM * glm::vec4(ray.origin, 1.0f));
+    glm::vec3 directionObject = glm::vec3(inverseCTM * glm::vec4(ray.direction, 0.0f));
+
+    float t;
+    int face;
+    glm::vec2 barycentric;
+    if (!group.meshes[slot]->closestHit(Ray {originObject, directionObject}, t, face, barycentric)) return;
+
+    if (t < hit.t && t > 1e-6f) {
+
+        hit.t = t;
+        hit.shapeIndex = group.shapeIndices[slot];
+        hit.hitPointObject = originObject + t * directionObject;
+        hit.face = face;
+        hit.barycentric = barycentric;
+        hit.instance = -1;
+
+    }
+
+}
+
+void ShapeArrays::intersectMeshSlot(const Group &group, int slot, const RayPacket &packet, PacketHit &hit) {
+
+    // The triangle BVH is traversed one ray at a time; rays of a packet rarely share its leaves.
+    float origins[3][RAY_PACKET_WIDTH], directions[3][RAY_PACKET_WIDTH];
+    packet.originX.store(origins[0]);
+    packet.originY.store(origins[1]);
+    packet.originZ.store(origins[2]);
+    packet.directionX.store(directions[0]);
+    packet.directionY.store(directions[1]);
+    packet.directionZ.store(directions[2]);
+
+    float t[RAY_PACKET_WIDTH];
+
+    for (int lane = 0; lane < RAY_PACKET_WIDTH; lane++) {
+
+        if (packet.active.lane(lane)) {
+
+            Ray ray {glm::vec3(origins[0][lane], origins[1][lane], origins[2][lane]),
+                     glm::vec3(directions[0][lane], directions[1][lane], directions[2][lane])};
+            intersectMeshSlot(group, slot, ray, 1.0f / ray.direction, hit.lanes[lane]);
+
+        }
+
+        t[lane] = hit.lanes[lane].t;
+
+    }
+
+    hit.t = PacketFloat::load(t);
+
+}
+
+bool ShapeArrays::occludedMeshSlot(const Group &group, int slot, const Ray &ray, const glm::vec3 &invDirection, float tMax) {
+
+    if (!mayHit(group, slot, ray, invDirection, tMax)) return false;
+
+    const glm::mat4 &inverseCTM = group.inverseCTMs[slot];
+
+    glm::vec3 originObject    = glm::vec3(inverseCTM * glm::vec4(ray.origin, 1.0f));
+    glm::vec3 directionObject = glm::vec3(inverseCTM * glm::vec4(ray.direction, 0.0f));
+
+    return group.meshes[slot]->anyHit(Ray {originObject, directionObject}, tMax);
+
+}
+
+void ShapeArrays::intersectAll(const Ray &ray, ShapeHit &hit) const {
+
+    const Group &cubes     = m_groups[(int)PrimitiveType::PRIMITIVE_CUBE];
+    const Group &cones     = m_groups[(int)PrimitiveType::PRIMITIVE_CONE];
+    const Group &cylinders = m_groups[(int)PrimitiveType::PRIMITIVE_CYLINDER];
+    const Group &spheres   = m_groups[(int)PrimitiveType::PRIMITIVE_SPHERE];
+    const Group &meshes    = m_groups[(int)PrimitiveType::PRIMITIVE_MESH];
+
+    glm::vec3 invDirection = 1.0f / ray.direction;
+
+    for (int slot = 0; slot < (int)cubes.shapeIndices.size(); slot++) intersectSlot<Cube>(cubes, slot, ray, invDirection, hit);
+    for (int slot = 0; slot < (int)cones.shapeIndices.size(); slot++) intersectSlot<Cone>(cones, slot, ray, invDirection, hit);
+    for (int slot = 0; slot < (int)cylinders.shapeIndices.size(); slot++) intersectSlot<Cylinder>(cylinders, slot, ray, invDirection, hit);
+    for (int slot = 0; slot < (int)spheres.shapeIndices.size(); slot++) intersectSlot<Sphere>(spheres, slot, ray, invDirection, hit);
+    for (int slot = 0; slot < (int)meshes.shapeIndices.size(); slot++) intersectMeshSlot(meshes, slot, ray, invDirection, hit);
+
+}
+
+void ShapeArrays::intersect(int shapeIndex, const Ray &ray, ShapeHit &hit) const {
+
+    const Location &location = m_locations[shapeIndex];
+    const Group &group = m_groups[location.group];
+
+    glm::vec3 invDirection = 1.0f / ray.direction;
+
+    switch ((PrimitiveType)location.group) {
+
+    case PrimitiveType::PRIMITIVE_CUBE:
+        intersectSlot<Cube>(group, location.slot, ray, invDirection, hit);
+        break;
+    case PrimitiveType::PRIMITIVE_CONE:
+        intersectSlot<Cone>(group, location.slot, ray, invDirection, hit);
+        break;
+    case PrimitiveType::PRIMITIVE_CYLINDER:
+        intersectSlot<Cylinder>(group, location.slot, ray, invDirection, hit);
+        break;
+    case PrimitiveType::PRIMITIVE_SPHERE:
+        intersectSlot<Sphere>(group, location.slot, ray, invDirection, hit);
+        break;
+    case PrimitiveType::PRIMITIVE_MESH:
+        intersectMeshSlot(group, location.slot, ray, invDirection, hit);
+        break;
+    default:
+        break;
+
+    }
+
+}
+
+void ShapeArrays::intersectAll(const RayPacket &packet, PacketHit &hit) const {
+
+    const Group &cubes     = m_groups[(int)PrimitiveType::PRIMITIVE_CUBE];
+    const Group &cones     = m_groups[(int)PrimitiveType::PRIMITIVE_CONE];
+    const Group &cylinders = m_groups[(int)PrimitiveType::PRIMITIVE_CYLINDER];
+    const Group &spheres   = m_groups[(int)PrimitiveType::PRIMITIVE_SPHERE];
+    const Group &meshes    = m_groups[(int)PrimitiveType::PRIMITIVE_MESH];
+
+    for (int slot = 0; slot < (int)cubes.shapeIndices.size(); slot++) intersectSlot<Cube>(cubes, slot, packet, hit);
+    for (int slot = 0; slot < (int)cones.shapeIndices.size(); slot++) intersectSlot<Cone>(cones, slot, packet, hit);
+    for (int slot = 0; slot < (int)cylinders.shapeIndices.size(); slot++) intersectSlot<Cylinder>(cylinders, slot, packet, hit);
+    for (int slot = 0; slot < (int)spheres.shapeIndices.size(); slot++) intersectSlot<Sphere>(spheres, slot, packet, hit);
+    for (int slot = 0; slot < (int)meshes.shapeIndices.size(); slot++) intersectMeshSlot(meshes, slot, packet, hit);
+
+}
+
+void ShapeArrays::intersect(int shapeIndex, const RayPacket &packet, PacketHit &hit) const {
+
+    const Location &location = m_locations[shapeIndex];
+    const Group &group = m_groups[location.group];
+
+    switch ((PrimitiveType)location.group) {
+
+    case PrimitiveType::PRIMITIVE_CUBE:
+        intersectSlot<Cube>(group, location.slot, packet, hit);
+        break;
+    case PrimitiveType::PRIMITIVE_CONE:
+        intersectSlot<Cone>(group, location.slot, packet, hit);
+        break;
+    case PrimitiveType::PRIMITIVE_CYLINDER:
+        intersectSlot<Cylinder>(group, location.slot, packet, hit);
+        break;
+    case PrimitiveType::PRIMITIVE_SPHERE:
+        intersectSlot<Sphere>(group, location.slot, packet, hit);
+        break;
+    case PrimitiveType::PRIMITIVE_MESH:
+        intersectMeshSlot(group, location.slot, packet, hit);
+        break;
+    default:
+        break;
+
+    }
+
+}
+
+bool ShapeArrays::occluded(int shapeIndex, const Ray &ray, float tMax) const {
+
+    const Location &location = m_locations[shapeIndex];
+    const Group &group = m_groups[location.group];
+
+    glm::vec3 invDirection = 1.0f / ray.direction;
+
+    switch ((PrimitiveType)location.group) {
+
+    case PrimitiveType::PRIMITIVE_CUBE:
+        return occludedSlot<Cube>(group, location.slot, ray, invDirection, tMax);
+    case PrimitiveType::PRIMITIVE_CONE:
+        return occludedSlot<Cone>(group, location.slot, ray, invDirection, tMax);
+    case PrimitiveType::PRIMITIVE_CYLINDER:
+        return occludedSlot<Cylinder>(group, location.slot, ray, invDirection, tMax);
+    case PrimitiveType::PRIMITIVE_SPHERE:
+        return occludedSlot<Sphere>(group, location.slot, ray, invDirection, tMax);
+    case PrimitiveType::PRIMITIVE_MESH:
+        return occludedMeshSlot(group, location.slot, ray, invDirection, tMax);
+    default:
+        return false;
+
+    }
+
+}
+
+template <typename Kernel>
+int ShapeArrays::findOccluderInGroup(const Group &group, const Ray &ray, const glm::vec3 &invDirection, float tMax, int skipIndex) {
+
+    for (int slot = 0; slot < (int)group.shapeIndices.size(); slot++) {
+
+        if (group.shapeIndices[slot] == skipIndex) continue;
+        if (occludedSlot<Kernel>(group, slot, ray, invDirection, tMax)) return group.shapeIndices[slot];
+
+    }
+
+    return -1;
+
+}
+
+int ShapeArrays::findOccluder(const Ray &ray, float tMax, int skipIndex) const {
+
+    glm::vec3 invDirection = 1.0f / ray.direction;
+
+    int occluder = findOccluderInGroup<Cube>(m_groups[(int)PrimitiveType::PRIMITIVE_CUBE], ray, invDirection, tMax, skipIndex);
+    if (occluder < 0) occluder = findOccluderInGroup<Cone>(m_groups[(int)PrimitiveType::PRIMITIVE_CONE], ray, invDirection, tMax, skipIndex);
+    if (occluder < 0) occluder = findOccluderInGroup<Cylinder>(m_groups[(int)PrimitiveType::PRIMITIVE_CYLINDER], ray, invDirection, tMax, skipIndex);
+    if (occluder < 0) occluder = findOccluderInGroup<Sphere>(m_groups[(int)PrimitiveType::PRIMITIVE_SPHERE], ray, invDirection, tMax, skipIndex);
+
+    const Group &meshes = m_groups[(int)PrimitiveType::PRIMITIVE_MESH];
+    for (int slot = 0; slot < (int)meshes.shapeIndices.size() && occluder < 0; slot++) {
+        if (meshes.shapeIndices[slot] != skipIndex && occludedMeshSlot(meshes, slot, ray, invDirection, tMax)) occluder = meshes.shapeIndices[slot];
+    }
+
+    return occluder;
+
+}
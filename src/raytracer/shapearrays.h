@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+#include "camera/camera.h"
+#include "shapes/mesh.h"
+#include "shapes/packet.h"
+#include "shapes/shape.h"
+#include "utils/aabb.h"
+
+// The closest intersection found so far along a world space ray.
+struct ShapeHit {
+    float t = INFINITY;       // Distance along the (normalized) world space ray; the same value in object space
+    int shapeIndex = -1;      // Index into RayTraceScene::getShapeData(), which holds material and texture
+    glm::vec3 hitPointObject; // Object space hit point
+    int face = -1;            // Triangle of a mesh that was hit, -1 for the analytic primitives
+    glm::vec2 barycentric;    // Barycentric coordinates of the hit on that triangle
+    int instance = -1;        // Instance the shape was hit through (see InstanceArrays), -1 for shapes placed directly
+};
+
+// The closest intersections found so far for every lane of a ray packet.
+struct PacketHit {
+    PacketFloat t = PacketFloat(INFINITY); // Same as lanes[i].t, packed for the traversal loops
+    ShapeHit lanes[RAY_PACKET_WIDTH];
+};
+
+// A flat, structure-of-arrays copy of the scene's primitives, grouped by type.
+// Each group keeps its transforms in contiguous arrays and runs the non-virtual intersection
+// kernel of its primitive type over them, so the per-ray loops neither touch shared_ptr
+// reference counts nor dispatch through the Shape vtable.
+// Every primitive also has a world space bounding sphere and box, which reject most rays before
+// they are transformed into object space. All queries expect normalized ray directions.
+
+class ShapeArrays
+{
+public:
+    void build(const std::vector<std::shared_ptr<Shape>> &shapes);
+
+    // Refreshes the transforms and bounds of the given shapes after their CTMs changed.
+    // shapes must be the list the arrays were built from.
+    void update(const std::vector<std::shared_ptr<Shape>> &shapes, const std::vector<int> &shapeIndices);
+
+    // Tests the ray against every primitive and keeps the closest hit nearer than hit.t.
+    void intersectAll(const Ray &ray, ShapeHit &hit) const;
+
+    // Tests the ray against a single primitive and keeps it if it is nearer than hit.t.
+    void intersect(int shapeIndex, const Ray &ray, ShapeHit &hit) const;
+
+    // World space bounds of a primitive, as computed by build().
+    const AABB &worldBounds(int shapeIndex) const;
+
+    // Packet versions of the two queries above. Every active lane is tested and updated independently.
+    void intersectAll(const RayPacket &packet, PacketHit &hit) const;
+    void intersect(int shapeIndex, const RayPacket &packet, PacketHit &hit) const;
+
+    // Returns true if the primitive blocks the ray somewhere in (0, tMax).
+    bool occluded(int shapeIndex, const Ray &ray, float tMax) const;
+
+    // Returns the first primitive that blocks the ray in (0, tMax), or -1. Skips primitive skipIndex.
+    int findOccluder(const Ray &ray, float tMax, int skipIndex = -1) const;
+
+private:
+
+    struct Group {
+        std::vector<glm::mat4> inverseCTMs;
+        std::vector<glm::vec4> boundingSpheres; // World space center in xyz, radius in w
+        std::vector<AABB> bounds;
+        std::vector<int> shapeIndices;
+        std::vector<const Mesh *> meshes; // Only filled for the mesh group, whose kernels need per-instance data
+    };
+
+    struct Location {
+        int group;
+        int slot;
+    };
+
+    // One group per primitive type, indexed by PrimitiveType.
+    static constexpr int GroupCount = 5;
+    Group m_groups[GroupCount];
+
+    // Where each shape of the scene lives in m_groups.
+    std::vector<Location> m_locations;
+
+    static void place(Group &group, int slot, const Shape &shape);
+
+    static bool mayHit(const Group &group, int slot, const Ray &ray, const glm::vec3 &invDirection, float tMax);
+
+    template <typename Kernel>
+    static void intersectSlot(const Group &group, int slot, const Ray &ray, const glm::vec3 &invDirection, ShapeHit &hit);
+
+    template <typename Kernel>
+    static void intersectSlot(const Group &group, int slot, const RayPacket &packet, PacketHit &hit);
+
+    template <typename Kernel>
+    static bool occludedSlot(const Group &group, int slot, const Ray &ray, const glm::vec3 &invDirection, float tMax);
+
+    static void intersectMeshSlot(const Group &group, int slot, const Ray &ray, const glm::vec3 &invDirection, ShapeHit &hit);
+    static void intersectMeshSlot(const Group &group, int slot, const RayPacket &packet, PacketHit &hit);
+    static bool occludedMeshSlot(const Group &group, int slot, const Ray &ray, const glm::vec3 &invDirection, float tMax);
+
+    template <typename Kernel>
+    static int findOccluderInGroup(const Group &group, const Ray &ray, const glm::vec3 &invDirection, float tMax, int skipIndex);
+};
@@ -0,0 +1,118 @@
+#include "tilescheduler.h"
+#include <algorithm>
+#include <thread>
+
+TileScheduler::TileScheduler(int width, int height, int tileSize, int threadCount) :
+    m_width(width),
+    m_height(height),
+    m_tileSize(std::max(1, tileSize))
+{
+
+    if (threadCount <= 0) threadCount = (int)std::thread::hardware_concurrency();
+    m_threadCount = std::max(1, threadCount);
+
+    for (int worker = 0; worker < m_threadCount; worker++) {
+        m_queues.push_back(std::make_unique<WorkerQueue>());
+    }
+
+}
+
+int TileScheduler::threadCount() const {
+    return m_threadCount;
+}
+
+// Hands every worker a contiguous run of tiles in scanline order.
+void TileScheduler::distributeTiles() {
+
+    std::vector<Tile> tiles;
+
+    for (int y = 0; y < m_height; y += m_tileSize) {
+        for (int x = 0; x < m_width; x += m_tileSize) {
+
+            tiles.push_back(Tile{x, y, std::min(x + m_tileSize, m_width), std::min(y + m_tileSize, m_height)});
+
+        }
+    }
+
+    int tileCount = (int)tiles.size();
+
+    for (int worker = 0; worker < m_threadCount; worker++) {
+
+        int begin = (int)((long long)tileCount * worker / m_threadCount);
+        int end = (int)((long long)tileCount * (worker + 1) / m_threadCount);
+
+        WorkerQueue &queue = *m_queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tiles.assign(tiles.begin() + begin, tiles.begin() + end);
+
+    }
+
+}
+
+// Owners take tiles from the front of their queue...
+bool TileScheduler::popLocal(int worker, Tile &tile) {
+
+    WorkerQueue &queue = *m_queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.tiles.empty()) return false;
+
+    tile = queue.tiles.front();
+    queue.tiles.pop_front();
+
+    return true;
+
+}
+
+// ...while thieves take them from the back, away from where the owner is working.
+bool TileScheduler::steal(int worker, Tile &tile) {
+
+    for (int offset = 1; offset < m_threadCount; offset++) {
+
+        WorkerQueue &victim = *m_queues[(worker + offset) % m_threadCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.tiles.empty()) {
+
+            tile = victim.tiles.back();
+            victim.tiles.pop_back();
+
+            return true;
+
+        }
+
+    }
+
+    return false;
+
+}
+
+void TileScheduler::workerLoop(int worker, const std::function<void(const Tile &)> &renderTile) {
+
+    Tile tile;
+
+    // No tiles are added once rendering starts, so finding every queue empty means we are done.
+    while (popLocal(worker, tile) || steal(worker, tile)) {
+        renderTile(tile);
+    }
+
+}
+
+void TileScheduler::run(const std::function<void(const Tile &)> &renderTile) {
+
+    distributeTiles();
+
+    std::vector<std::thread> workers;
+
+    for (int worker = 1; worker < m_threadCount; worker++) {
+        workers.emplace_back(&TileScheduler::workerLoop, this, worker, std::cref(renderTile));
+    }
+
+    // The calling thread works as well instead of idling in join().
+    workerLoop(0, renderTile);
+
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+
+}
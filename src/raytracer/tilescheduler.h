@@ -0,0 +1,55 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A rectangular block of pixels, [x0, x1) x [y0, y1).
+struct Tile {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+// A class that splits an image into tiles and renders them on a pool of worker threads.
+// Each worker owns a queue holding a contiguous run of tiles; once its own queue is empty
+// it steals tiles from the back of the other queues, so expensive regions of the image
+// (e.g. a mirror in one corner) are shared out instead of stalling a single thread.
+
+class TileScheduler
+{
+public:
+    // @param width The width of the image in pixels.
+    // @param height The height of the image in pixels.
+    // @param tileSize The side length of a tile in pixels.
+    // @param threadCount The number of worker threads; 0 picks the hardware concurrency.
+    TileScheduler(int width, int height, int tileSize, int threadCount = 0);
+
+    // Runs renderTile once for every tile, blocking until all tiles are done.
+    // renderTile is called concurrently from several threads and must only write to its own tile.
+    void run(const std::function<void(const Tile &)> &renderTile);
+
+    int threadCount() const;
+
+private:
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Tile> tiles;
+    };
+
+    int m_width;
+    int m_height;
+    int m_tileSize;
+    int m_threadCount;
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+
+    void distributeTiles();
+    bool popLocal(int worker, Tile &tile);
+    bool steal(int worker, Tile &tile);
+    void workerLoop(int worker, const std::function<void(const Tile &)> &renderTile);
+};
@@ -1,8 +1,9 @@
 #include "cone.h"
 #include <glm/glm.hpp>
 #include <algorithm>
+#include <cmath>
 
-bool Cone::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
+bool Cone::closestHit(const Ray& ray, float& t) {
 
     float base = -0.5;
 
@@ -14,7 +15,8 @@ bool Cone::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
               - (0.25f * ray.origin.y * ray.origin.y) + (0.25f * ray.origin.y) - (1.0f/16.0f);
     float d = discriminant(a, b, c);
 
-    std::vector<float> tVals = std::vector<float>();
+    // Nearest valid candidate so far; no need to collect them all.
+    float tMin = INFINITY;
 
     // Conical Top Intersection
     if (!(d < 0)) {
@@ -25,8 +27,8 @@ bool Cone::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
         glm::vec3 p1 = ray.origin + t1 * ray.direction;
         glm::vec3 p2 = ray.origin + t2 * ray.direction;
 
-        if ((p1.y < 0.5 && p1.y > -0.5) && t1 > 0) tVals.push_back(t1);
-        if ((p2.y < 0.5 && p2.y > -0.5) && t2 > 0) tVals.push_back(t2);
+        if ((p1.y < 0.5 && p1.y > -0.5) && t1 > 0) tMin = std::min(tMin, t1);
+        if ((p2.y < 0.5 && p2.y > -0.5) && t2 > 0) tMin = std::min(tMin, t2);
 
     }
 
@@ -36,15 +38,13 @@ bool Cone::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
         float t3 = (base - ray.origin.y) / ray.direction.y;
         glm::vec3 p3 = ray.origin + t3 * ray.direction;
 
-        if ((((p3.x * p3.x) + (p3.z * p3.z)) < 0.25) && t3 > 0) tVals.push_back(t3);
+        if ((((p3.x * p3.x) + (p3.z * p3.z)) < 0.25) && t3 > 0) tMin = std::min(tMin, t3);
 
     }
 
-    if (!tVals.empty()) {
-
-        t = *std::min_element(tVals.begin(), tVals.end());
-        hitPoint = ray.origin + t * ray.direction;
+    if (tMin < INFINITY) {
 
+        t = tMin;
         return true;
 
     }
@@ -53,12 +53,99 @@ bool Cone::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
 
 }
 
+bool Cone::anyHit(const Ray& ray, float tMax) {
+
+    float a = ray.direction.x * ray.direction.x + ray.direction.z * ray.direction.z
+              - (0.25f * ray.direction.y * ray.direction.y);
+    float b = 2.0f * ray.origin.x * ray.direction.x + 2.0f * ray.origin.z * ray.direction.z
+              - 0.5f * ray.origin.y * ray.direction.y + 0.25f * ray.direction.y;
+    float c = ray.origin.x * ray.origin.x + ray.origin.z * ray.origin.z
+              - (0.25f * ray.origin.y * ray.origin.y) + (0.25f * ray.origin.y) - (1.0f/16.0f);
+    float d = discriminant(a, b, c);
+
+    // Conical Top --
+    if (!(d < 0)) {
+
+        for (float t : {(-b - glm::sqrt(d)) / (2 * a), (-b + glm::sqrt(d)) / (2 * a)}) {
+
+            float y = ray.origin.y + t * ray.direction.y;
+            if ((y < 0.5 && y > -0.5) && t > 0 && t < tMax) return true;
+
+        }
+
+    }
+
+    // Base --
+    if (ray.direction.y != 0) {
+
+        float t = (-0.5f - ray.origin.y) / ray.direction.y;
+        glm::vec3 p = ray.origin + t * ray.direction;
+        if ((((p.x * p.x) + (p.z * p.z)) < 0.25) && t > 0 && t < tMax) return true;
+
+    }
+
+    return false;
+
+}
+
+PacketMask Cone::closestHit(const RayPacket& ray, PacketFloat& t) {
+
+    PacketFloat zero(0.0f), half(0.5f), quarter(0.25f);
+
+    PacketFloat a = ray.directionX * ray.directionX + ray.directionZ * ray.directionZ
+                    - (quarter * ray.directionY * ray.directionY);
+    PacketFloat b = PacketFloat(2.0f) * ray.originX * ray.directionX + PacketFloat(2.0f) * ray.originZ * ray.directionZ
+                    - half * ray.originY * ray.directionY + quarter * ray.directionY;
+    PacketFloat c = ray.originX * ray.originX + ray.originZ * ray.originZ
+                    - (quarter * ray.originY * ray.originY) + (quarter * ray.originY) - PacketFloat(1.0f / 16.0f);
+    PacketFloat d = b * b - PacketFloat(4.0f) * a * c;
+
+    PacketFloat tMin(INFINITY);
+
+    // Conical Top --
+    PacketMask sideHit = !(d < zero);
+    PacketFloat sqrtD = sqrt(max(d, zero));
+
+    for (PacketFloat tSide : {(-b + sqrtD) / (PacketFloat(2.0f) * a), (-b - sqrtD) / (PacketFloat(2.0f) * a)}) {
+
+        PacketFloat y = ray.originY + tSide * ray.directionY;
+        PacketMask valid = sideHit & (y < half) & (y > -half) & (tSide > zero);
+        tMin = select(valid, min(tMin, tSide), tMin);
+
+    }
+
+    // Base --
+    PacketFloat tBase = (-half - ray.originY) / ray.directionY;
+    PacketFloat x = ray.originX + tBase * ray.directionX;
+    PacketFloat z = ray.originZ + tBase * ray.directionZ;
+
+    PacketMask baseHit = (ray.directionY != zero) & ((x * x + z * z) < quarter) & (tBase > zero);
+    tMin = select(baseHit, min(tMin, tBase), tMin);
+
+    t = tMin;
+    return ray.active & (tMin < PacketFloat(INFINITY));
+
+}
+
+bool Cone::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
+
+    if (!closestHit(ray, t)) return false;
+
+    hitPoint = ray.origin + t * ray.direction;
+    return true;
+
+}
+
+bool Cone::occluded(const Ray& ray, float tMax) const {
+    return anyHit(ray, tMax);
+}
+
 glm::vec3 Cone::computeNormal(glm::vec3& hitPoint) const {
 
     glm::vec3 normal;
 
     const float epsilon = 0.0001f;
-    if (abs(hitPoint.y + 0.5f) < epsilon) {
+    if (std::abs(hitPoint.y + 0.5f) < epsilon) {
         normal = glm::vec3(0, -1, 0);
     } else {
         normal = glm::normalize(glm::vec3(hitPoint.x, (0.5f - hitPoint.y) / 4.0f, hitPoint.z));
@@ -74,12 +161,12 @@ glm::vec2 Cone::computeUV(glm::vec3& hitPoint) const {
     const float epsilon = 0.0001f;
     float u, v;
 
-    if (abs(hitPoint.y + 0.5f) < epsilon) {
+    if (std::abs(hitPoint.y + 0.5f) < epsilon) {
 
         u = hitPoint.x + 0.5;
         v = hitPoint.z + 0.5;
 
-    } else if (abs(hitPoint.y - 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.y - 0.5f) < epsilon) {
 
         // Tip
         u = 0.5;
@@ -106,12 +193,12 @@ std::tuple<glm::vec3, glm::vec3> Cone::computeDifferentials(glm::vec3& hitPoint)
     float du_dx, du_dy, du_dz;
     float dv_dx, dv_dy, dv_dz;
 
-    if (abs(hitPoint.y + 0.5f) < epsilon) {
+    if (std::abs(hitPoint.y + 0.5f) < epsilon) {
 
         du_dp = glm::vec3(1.0f, 0.0f, 0.0f);
         dv_dp = glm::vec3(0.0f, 0.0f, 1.0f);
 
-    } else if (abs(hitPoint.y - 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.y - 0.5f) < epsilon) {
 
         du_dp = glm::vec3(1.0f, 0.0f, 0.0f);
         dv_dp = glm::vec3(0.0f, 0.0f, 1.0f);
@@ -1,13 +1,15 @@
 #include "cube.h"
 #include <glm/glm.hpp>
 #include <algorithm>
+#include <cmath>
 
-bool Cube::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
+bool Cube::closestHit(const Ray& ray, float& t) {
 
     float frontFace = 0.5f;
     float backFace = -0.5f;
 
-    std::vector<float> tVals = std::vector<float>();
+    // Nearest valid candidate so far; no need to collect them all.
+    float tMin = INFINITY;
 
     // X Face Intersections
     if (ray.direction.x != 0) {
@@ -18,8 +20,8 @@ bool Cube::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
     glm::vec3 p1 = ray.origin + t1 * ray.direction;
     glm::vec3 p2 = ray.origin + t2 * ray.direction;
 
-    if ((p1.y < 0.5 && p1.y > -0.5) && (p1.z < 0.5 && p1.z > -0.5) && t1 > 0) tVals.push_back(t1);
-    if ((p2.y < 0.5 && p2.y > -0.5) && (p2.z < 0.5 && p2.z > -0.5) && t2 > 0) tVals.push_back(t2);
+    if ((p1.y < 0.5 && p1.y > -0.5) && (p1.z < 0.5 && p1.z > -0.5) && t1 > 0) tMin = std::min(tMin, t1);
+    if ((p2.y < 0.5 && p2.y > -0.5) && (p2.z < 0.5 && p2.z > -0.5) && t2 > 0) tMin = std::min(tMin, t2);
 
     }
 
@@ -32,8 +34,8 @@ bool Cube::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
     glm::vec3 p3 = ray.origin + t3 * ray.direction;
     glm::vec3 p4 = ray.origin + t4 * ray.direction;
 
-    if ((p3.x < 0.5 && p3.x > -0.5) && (p3.z < 0.5 && p3.z > -0.5) && t3 > 0) tVals.push_back(t3);
-    if ((p4.x < 0.5 && p4.x > -0.5) && (p4.z < 0.5 && p4.z > -0.5) && t4 > 0) tVals.push_back(t4);
+    if ((p3.x < 0.5 && p3.x > -0.5) && (p3.z < 0.5 && p3.z > -0.5) && t3 > 0) tMin = std::min(tMin, t3);
+    if ((p4.x < 0.5 && p4.x > -0.5) && (p4.z < 0.5 && p4.z > -0.5) && t4 > 0) tMin = std::min(tMin, t4);
 
     }
     // Z Face Intersections
@@ -45,16 +47,14 @@ bool Cube::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
     glm::vec3 p5 = ray.origin + t5 * ray.direction;
     glm::vec3 p6 = ray.origin + t6 * ray.direction;
 
-    if ((p5.x < 0.5 && p5.x > -0.5) && (p5.y < 0.5 && p5.y > -0.5) && t5 > 0) tVals.push_back(t5);
-    if ((p6.x < 0.5 && p6.x > -0.5) && (p6.y < 0.5 && p6.y > -0.5) && t6 > 0) tVals.push_back(t6);
+    if ((p5.x < 0.5 && p5.x > -0.5) && (p5.y < 0.5 && p5.y > -0.5) && t5 > 0) tMin = std::min(tMin, t5);
+    if ((p6.x < 0.5 && p6.x > -0.5) && (p6.y < 0.5 && p6.y > -0.5) && t6 > 0) tMin = std::min(tMin, t6);
 
     }
 
-    if (!tVals.empty()) {
-
-        t = *std::min_element(tVals.begin(), tVals.end());
-        hitPoint = ray.origin + t * ray.direction;
+    if (tMin < INFINITY) {
 
+        t = tMin;
         return true;
 
     }
@@ -63,16 +63,88 @@ bool Cube::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
 
 }
 
+bool Cube::anyHit(const Ray& ray, float tMax) {
+
+    // Same face tests as rayIntersect, returning on the first face hit inside (0, tMax).
+    for (int axis = 0; axis < 3; axis++) {
+
+        if (ray.direction[axis] == 0) continue;
+
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+
+        for (float face : {0.5f, -0.5f}) {
+
+            float tFace = (face - ray.origin[axis]) / ray.direction[axis];
+            if (!(tFace > 0 && tFace < tMax)) continue;
+
+            glm::vec3 p = ray.origin + tFace * ray.direction;
+            if ((p[u] < 0.5 && p[u] > -0.5) && (p[v] < 0.5 && p[v] > -0.5)) return true;
+
+        }
+
+    }
+
+    return false;
+
+}
+
+PacketMask Cube::closestHit(const RayPacket& ray, PacketFloat& t) {
+
+    const PacketFloat *origin[3] = {&ray.originX, &ray.originY, &ray.originZ};
+    const PacketFloat *direction[3] = {&ray.directionX, &ray.directionY, &ray.directionZ};
+
+    PacketFloat tMin(INFINITY);
+
+    for (int axis = 0; axis < 3; axis++) {
+
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+
+        PacketMask facing = *direction[axis] != PacketFloat(0.0f);
+
+        for (float face : {0.5f, -0.5f}) {
+
+            PacketFloat tFace = (PacketFloat(face) - *origin[axis]) / *direction[axis];
+            PacketFloat pu = *origin[u] + tFace * *direction[u];
+            PacketFloat pv = *origin[v] + tFace * *direction[v];
+
+            PacketMask inside = facing & (pu < PacketFloat(0.5f)) & (pu > PacketFloat(-0.5f)) &
+                                (pv < PacketFloat(0.5f)) & (pv > PacketFloat(-0.5f)) & (tFace > PacketFloat(0.0f));
+            tMin = select(inside, min(tMin, tFace), tMin);
+
+        }
+
+    }
+
+    t = tMin;
+    return ray.active & (tMin < PacketFloat(INFINITY));
+
+}
+
+bool Cube::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
+
+    if (!closestHit(ray, t)) return false;
+
+    hitPoint = ray.origin + t * ray.direction;
+    return true;
+
+}
+
+bool Cube::occluded(const Ray& ray, float tMax) const {
+    return anyHit(ray, tMax);
+}
+
 glm::vec3 Cube::computeNormal(glm::vec3& hitPoint) const {
 
     glm::vec3 normal;
     const float epsilon = 0.0001f;
 
-    if (abs(hitPoint.x - 0.5f) < epsilon) { normal = glm::vec3(1, 0, 0); }
-    else if (abs(hitPoint.x + 0.5f) < epsilon) { normal = glm::vec3(-1, 0, 0); }
-    else if (abs(hitPoint.y - 0.5f) < epsilon) { normal = glm::vec3(0, 1, 0); }
-    else if (abs(hitPoint.y + 0.5f) < epsilon) { normal = glm::vec3(0, -1, 0); }
-    else if (abs(hitPoint.z - 0.5f) < epsilon) { normal = glm::vec3(0, 0, 1); }
+    if (std::abs(hitPoint.x - 0.5f) < epsilon) { normal = glm::vec3(1, 0, 0); }
+    else if (std::abs(hitPoint.x + 0.5f) < epsilon) { normal = glm::vec3(-1, 0, 0); }
+    else if (std::abs(hitPoint.y - 0.5f) < epsilon) { normal = glm::vec3(0, 1, 0); }
+    else if (std::abs(hitPoint.y + 0.5f) < epsilon) { normal = glm::vec3(0, -1, 0); }
+    else if (std::abs(hitPoint.z - 0.5f) < epsilon) { normal = glm::vec3(0, 0, 1); }
     else { normal = glm::vec3(0, 0, -1); }
 
     return normal;
@@ -84,27 +156,27 @@ glm::vec2 Cube::computeUV(glm::vec3& hitPoint) const {
     const float epsilon = 0.0001f;
     float u, v;
 
-    if (abs(hitPoint.x - 0.5f) < epsilon) {
+    if (std::abs(hitPoint.x - 0.5f) < epsilon) {
 
         u = -hitPoint.z + 0.5;
         v = hitPoint.y + 0.5;
 
-    } else if (abs(hitPoint.x + 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.x + 0.5f) < epsilon) {
 
         u = hitPoint.z + 0.5;
         v = hitPoint.y + 0.5;
 
-    } else if (abs(hitPoint.y - 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.y - 0.5f) < epsilon) {
 
         u = hitPoint.x + 0.5;
         v = -hitPoint.z + 0.5;
 
-    } else if (abs(hitPoint.y + 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.y + 0.5f) < epsilon) {
 
         u = hitPoint.x + 0.5;
         v = hitPoint.z + 0.5;
 
-    } else if (abs(hitPoint.z - 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.z - 0.5f) < epsilon) {
 
         u = hitPoint.x + 0.5;
         v = hitPoint.y + 0.5;
@@ -125,27 +197,27 @@ std::tuple<glm::vec3, glm::vec3> Cube::computeDifferentials(glm::vec3& hitPoint)
     const float epsilon = 0.0001f;
     glm::vec3 du_dp, dv_dp;
 
-    if (abs(hitPoint.x - 0.5f) < epsilon) {
+    if (std::abs(hitPoint.x - 0.5f) < epsilon) {
 
         du_dp = glm::vec3(0, 0, 1);
         dv_dp = glm::vec3(0, 1, 0);
 
-    } else if (abs(hitPoint.x + 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.x + 0.5f) < epsilon) {
 
         du_dp = glm::vec3(0, 0, -1);
         dv_dp = glm::vec3(0, 1, 0);
 
-    } else if (abs(hitPoint.y - 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.y - 0.5f) < epsilon) {
 
         du_dp = glm::vec3(1, 0, 0);
         dv_dp = glm::vec3(0, 0, -1);
 
-    } else if (abs(hitPoint.y + 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.y + 0.5f) < epsilon) {
 
         du_dp = glm::vec3(1, 0, 0);
         dv_dp = glm::vec3(0, 0, 1);
 
-    } else if (abs(hitPoint.z - 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.z - 0.5f) < epsilon) {
 
         du_dp = glm::vec3(-1, 0, 0);
         dv_dp = glm::vec3(0, 1, 0);
@@ -1,8 +1,9 @@
 #include "cylinder.h"
 #include <glm/glm.hpp>
 #include <algorithm>
+#include <cmath>
 
-bool Cylinder::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
+bool Cylinder::closestHit(const Ray& ray, float& t) {
 
     float topCap = 0.5;
     float bottomCap = -0.5;
@@ -12,7 +13,8 @@ bool Cylinder::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const
     float c = ray.origin.x * ray.origin.x + ray.origin.z * ray.origin.z - 0.25f;
     float d = discriminant(a, b, c);
 
-    std::vector<float> tVals = std::vector<float>();
+    // Nearest valid candidate so far; no need to collect them all.
+    float tMin = INFINITY;
 
     if (!(d < 0)) {
 
@@ -23,8 +25,8 @@ bool Cylinder::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const
         glm::vec3 p1 = ray.origin + t1 * ray.direction;
         glm::vec3 p2 = ray.origin + t2 * ray.direction;
 
-        if ((p1.y < 0.5 && p1.y > -0.5) && t1 > 0) tVals.push_back(t1);
-        if ((p2.y < 0.5 && p2.y > -0.5) && t2 > 0) tVals.push_back(t2);
+        if ((p1.y < 0.5 && p1.y > -0.5) && t1 > 0) tMin = std::min(tMin, t1);
+        if ((p2.y < 0.5 && p2.y > -0.5) && t2 > 0) tMin = std::min(tMin, t2);
 
     }
 
@@ -37,16 +39,14 @@ bool Cylinder::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const
     glm::vec3 p3 = ray.origin + t3 * ray.direction;
     glm::vec3 p4 = ray.origin + t4 * ray.direction;
 
-    if ((((p3.x * p3.x) + (p3.z * p3.z)) < 0.25f) && t3 > 0) tVals.push_back(t3);
-    if ((((p4.x * p4.x) + (p4.z * p4.z)) < 0.25f) && t4 > 0) tVals.push_back(t4);
+    if ((((p3.x * p3.x) + (p3.z * p3.z)) < 0.25f) && t3 > 0) tMin = std::min(tMin, t3);
+    if ((((p4.x * p4.x) + (p4.z * p4.z)) < 0.25f) && t4 > 0) tMin = std::min(tMin, t4);
 
     }
 
-    if (!tVals.empty()) {
-
-        t = *std::min_element(tVals.begin(), tVals.end());
-        hitPoint = ray.origin + t * ray.direction;
+    if (tMin < INFINITY) {
 
+        t = tMin;
         return true;
 
     }
@@ -56,16 +56,107 @@ bool Cylinder::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const
 
 }
 
+bool Cylinder::anyHit(const Ray& ray, float tMax) {
+
+    float a = ray.direction.x * ray.direction.x + ray.direction.z * ray.direction.z;
+    float b = 2.0f * ray.origin.x * ray.direction.x + 2.0f * ray.origin.z * ray.direction.z;
+    float c = ray.origin.x * ray.origin.x + ray.origin.z * ray.origin.z - 0.25f;
+    float d = discriminant(a, b, c);
+
+    // Cylinder Face --
+    if (!(d < 0)) {
+
+        for (float t : {(-b - glm::sqrt(d)) / (2 * a), (-b + glm::sqrt(d)) / (2 * a)}) {
+
+            float y = ray.origin.y + t * ray.direction.y;
+            if ((y < 0.5 && y > -0.5) && t > 0 && t < tMax) return true;
+
+        }
+
+    }
+
+    // Caps --
+    if (ray.direction.y != 0) {
+
+        for (float cap : {0.5f, -0.5f}) {
+
+            float t = (cap - ray.origin.y) / ray.direction.y;
+            glm::vec3 p = ray.origin + t * ray.direction;
+            if ((((p.x * p.x) + (p.z * p.z)) < 0.25f) && t > 0 && t < tMax) return true;
+
+        }
+
+    }
+
+    return false;
+
+}
+
+PacketMask Cylinder::closestHit(const RayPacket& ray, PacketFloat& t) {
+
+    PacketFloat zero(0.0f), half(0.5f);
+
+    PacketFloat a = ray.directionX * ray.directionX + ray.directionZ * ray.directionZ;
+    PacketFloat b = PacketFloat(2.0f) * ray.originX * ray.directionX + PacketFloat(2.0f) * ray.originZ * ray.directionZ;
+    PacketFloat c = ray.originX * ray.originX + ray.originZ * ray.originZ - PacketFloat(0.25f);
+    PacketFloat d = b * b - PacketFloat(4.0f) * a * c;
+
+    PacketFloat tMin(INFINITY);
+
+    // Cylinder Face --
+    PacketMask sideHit = !(d < zero);
+    PacketFloat sqrtD = sqrt(max(d, zero));
+
+    for (PacketFloat tSide : {(-b + sqrtD) / (PacketFloat(2.0f) * a), (-b - sqrtD) / (PacketFloat(2.0f) * a)}) {
+
+        PacketFloat y = ray.originY + tSide * ray.directionY;
+        PacketMask valid = sideHit & (y < half) & (y > -half) & (tSide > zero);
+        tMin = select(valid, min(tMin, tSide), tMin);
+
+    }
+
+    // Caps --
+    PacketMask capHit = ray.directionY != zero;
+
+    for (float cap : {0.5f, -0.5f}) {
+
+        PacketFloat tCap = (PacketFloat(cap) - ray.originY) / ray.directionY;
+        PacketFloat x = ray.originX + tCap * ray.directionX;
+        PacketFloat z = ray.originZ + tCap * ray.directionZ;
+
+        PacketMask valid = capHit & ((x * x + z * z) < PacketFloat(0.25f)) & (tCap > zero);
+        tMin = select(valid, min(tMin, tCap), tMin);
+
+    }
+
+    t = tMin;
+    return ray.active & (tMin < PacketFloat(INFINITY));
+
+}
+
+bool Cylinder::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
+
+    if (!closestHit(ray, t)) return false;
+
+    hitPoint = ray.origin + t * ray.direction;
+    return true;
+
+}
+
+bool Cylinder::occluded(const Ray& ray, float tMax) const {
+    return anyHit(ray, tMax);
+}
+
 glm::vec3 Cylinder::computeNormal(glm::vec3& hitPoint) const {
 
     glm::vec3 normal;
     const float epsilon = 0.0001f;
 
-    if (abs(hitPoint.y - 0.5f) < epsilon) {
+    if (std::abs(hitPoint.y - 0.5f) < epsilon) {
 
         normal = glm::vec3(0, 1, 0);
 
-    } else if (abs(hitPoint.y + 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.y + 0.5f) < epsilon) {
 
         normal = glm::vec3(0, -1, 0);
 
@@ -84,12 +175,12 @@ glm::vec2 Cylinder::computeUV( glm::vec3& hitPoint ) const {
     const float epsilon = 0.0001f;
     float u, v;
 
-    if (abs(hitPoint.y - 0.5f) < epsilon) {
+    if (std::abs(hitPoint.y - 0.5f) < epsilon) {
 
         u = hitPoint.x + 0.5f;
         v = -hitPoint.z + 0.5f;
 
-    } else if (abs(hitPoint.y + 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.y + 0.5f) < epsilon) {
 
         u = hitPoint.x + 0.5f;
         v = hitPoint.z + 0.5f;
@@ -116,12 +207,12 @@ std::tuple<glm::vec3, glm::vec3> Cylinder::computeDifferentials(glm::vec3& hitPo
     float du_dx, du_dy, du_dz;
     float dv_dx, dv_dy, dv_dz;
 
-    if (abs(hitPoint.y - 0.5f) < epsilon) {
+    if (std::abs(hitPoint.y - 0.5f) < epsilon) {
 
         du_dp = glm::vec3(1, 0, 0);
         dv_dp = glm::vec3(0, 0, -1);
 
-    } else if (abs(hitPoint.y + 0.5f) < epsilon) {
+    } else if (std::abs(hitPoint.y + 0.5f) < epsilon) {
 
         du_dp = glm::vec3(1, 0, 0);
         dv_dp = glm::vec3(0, 0, 1);
@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 #include "camera/camera.h"
+#include "packet.h"
 #include "shape.h"
 
 class Cylinder : public Shape {
@@ -13,6 +14,14 @@ public:
         float& t,
         glm::vec3& hitPoint) const override;
 
+    bool occluded(const Ray& ray, float tMax) const override;
+
+    // Non-virtual kernels behind rayIntersect and occluded, used directly by the flat scene arrays.
+    // The packet overload tests RAY_PACKET_WIDTH object space rays at once with the same rules.
+    static bool closestHit(const Ray& ray, float& t);
+    static bool anyHit(const Ray& ray, float tMax);
+    static PacketMask closestHit(const RayPacket& ray, PacketFloat& t);
+
     glm::vec3 computeNormal(glm::vec3& hitPoint ) const override;
     glm::vec2 computeUV( glm::vec3& hitPoint ) const override;
     std::tuple<glm::vec3, glm::vec3> computeDifferentials( glm::vec3& hitPoint ) const override;
@@ -0,0 +1,268 @@
+#include "mesh.h"
+#include <glm/glm.hpp>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+// Meshes that are currently loaded, by file name. Entries expire with the last Mesh using them.
+// As with textures, the cache lock only guards the map and each entry's own lock is held while its mesh is built.
+struct MeshCacheEntry {
+    std::mutex mutex;
+    std::weak_ptr<const TriangleMesh> mesh;
+};
+
+static std::mutex meshCacheMutex;
+static std::map<std::string, std::shared_ptr<MeshCacheEntry>> meshCache;
+
+std::shared_ptr<const TriangleMesh> TriangleMesh::load(const std::string &file) {
+
+    std::shared_ptr<MeshCacheEntry> entry;
+
+    {
+        std::lock_guard<std::mutex> lock(meshCacheMutex);
+
+        std::shared_ptr<MeshCacheEntry> &slot = meshCache[file];
+        if (!slot) slot = std::make_shared<MeshCacheEntry>();
+        entry = slot;
+    }
+
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (std::shared_ptr<const TriangleMesh> cached = entry->mesh.lock()) return cached;
+
+    std::shared_ptr<TriangleMesh> mesh = std::make_shared<TriangleMesh>();
+    if (!loadMeshFromFile(file, mesh->data)) return nullptr;
+
+    std::vector<AABB> triangleBounds;
+    triangleBounds.reserve(mesh->data.triangles.size());
+
+    for (const glm::ivec3 &triangle : mesh->data.triangles) {
+
+        AABB bounds;
+        for (int corner = 0; corner < 3; corner++) bounds.expand(mesh->data.positions[triangle[corner]]);
+
+        triangleBounds.push_back(bounds);
+        mesh->bounds.expand(bounds);
+
+    }
+
+    mesh->bvh.build(triangleBounds);
+    entry->mesh = mesh;
+
+    return mesh;
+
+}
+
+// Möller-Trumbore ray/triangle test. barycentric holds the weights of p1 and p2.
+bool Mesh::intersectTriangle(const Ray& ray, const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2,
+                             float& t, glm::vec2& barycentric) {
+
+    glm::vec3 edge1 = p1 - p0;
+    glm::vec3 edge2 = p2 - p0;
+
+    glm::vec3 p = glm::cross(ray.direction, edge2);
+    float determinant = glm::dot(edge1, p);
+
+    // The ray runs parallel to the triangle (or the triangle is degenerate).
+    if (std::abs(determinant) < 1e-12f) return false;
+
+    float inverseDeterminant = 1.0f / determinant;
+    glm::vec3 toOrigin = ray.origin - p0;
+
+    float u = glm::dot(toOrigin, p) * inverseDeterminant;
+    if (u < 0.0f || u > 1.0f) return false;
+
+    glm::vec3 q = glm::cross(toOrigin, edge1);
+    float v = glm::dot(ray.direction, q) * inverseDeterminant;
+    if (v < 0.0f || u + v > 1.0f) return false;
+
+    t = glm::dot(edge2, q) * inverseDeterminant;
+    barycentric = glm::vec2(u, v);
+
+    return t > 0.0f;
+
+}
+
+bool Mesh::closestHit(const Ray& ray, float& t, int& face, glm::vec2& barycentric) const {
+
+    const MeshData &data = m_mesh->data;
+    float tMin = INFINITY;
+
+    m_mesh->bvh.closestHit(ray, tMin, [&](int index) {
+
+        const glm::ivec3 &triangle = data.triangles[index];
+        float tTriangle;
+        glm::vec2 weights;
+
+        if (intersectTriangle(ray, data.positions[triangle[0]], data.positions[triangle[1]], data.positions[triangle[2]],
+                              tTriangle, weights) && tTriangle < tMin) {
+            tMin = tTriangle;
+            face = index;
+            barycentric = weights;
+        }
+
+    });
+
+    if (tMin < INFINITY) {
+
+        t = tMin;
+        return true;
+
+    }
+
+    return false;
+
+}
+
+bool Mesh::anyHit(const Ray& ray, float tMax) const {
+
+    const MeshData &data = m_mesh->data;
+
+    return m_mesh->bvh.anyHit(ray, tMax, [&](int index) {
+
+        const glm::ivec3 &triangle = data.triangles[index];
+        float t;
+        glm::vec2 barycentric;
+
+        return intersectTriangle(ray, data.positions[triangle[0]], data.positions[triangle[1]], data.positions[triangle[2]],
+                                 t, barycentric) && t < tMax;
+
+    });
+
+}
+
+bool Mesh::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
+
+    int face;
+    glm::vec2 barycentric;
+    if (!closestHit(ray, t, face, barycentric)) return false;
+
+    hitPoint = ray.origin + t * ray.direction;
+    return true;
+
+}
+
+bool Mesh::occluded(const Ray& ray, float tMax) const {
+    return anyHit(ray, tMax);
+}
+
+glm::vec3 Mesh::computeNormal(glm::vec3& hitPoint, int face, glm::vec2 barycentric) const {
+
+    const MeshData &data = m_mesh->data;
+    const glm::ivec3 &triangle = data.triangles[face];
+
+    glm::vec3 normal = (1.0f - barycentric.x - barycentric.y) * data.normals[triangle[0]] +
+                       barycentric.x * data.normals[triangle[1]] +
+                       barycentric.y * data.normals[triangle[2]];
+
+    // Opposing vertex normals can cancel out; the flat face normal is the only sensible answer then.
+    if (glm::dot(normal, normal) < 1e-12f) {
+        normal = glm::cross(data.positions[triangle[1]] - data.positions[triangle[0]],
+                            data.positions[triangle[2]] - data.positions[triangle[0]]);
+    }
+
+    return glm::normalize(normal);
+
+}
+
+glm::vec2 Mesh::computeUV(glm::vec3& hitPoint, int face, glm::vec2 barycentric) const {
+
+    const MeshData &data = m_mesh->data;
+    const glm::ivec3 &triangle = data.triangles[face];
+
+    return (1.0f - barycentric.x - barycentric.y) * data.uvs[triangle[0]] +
+           barycentric.x * data.uvs[triangle[1]] +
+           barycentric.y * data.uvs[triangle[2]];
+
+}
+
+std::tuple<glm::vec3, glm::vec3> Mesh::computeDifferentials(glm::vec3& hitPoint, int face, glm::vec2 barycentric) const {
+
+    const MeshData &data = m_mesh->data;
+    const glm::ivec3 &triangle = data.triangles[face];
+
+    glm::vec3 edge1 = data.positions[triangle[1]] - data.positions[triangle[0]];
+    glm::vec3 edge2 = data.positions[triangle[2]] - data.positions[triangle[0]];
+    glm::vec2 uvEdge1 = data.uvs[triangle[1]] - data.uvs[triangle[0]];
+    glm::vec2 uvEdge2 = data.uvs[triangle[2]] - data.uvs[triangle[0]];
+
+    glm::vec3 normal = glm::cross(edge1, edge2);
+    float area2 = glm::dot(normal, normal);
+    if (area2 == 0.0f) return std::make_tuple(glm::vec3(0.0f), glm::vec3(0.0f));
+
+    // Dual basis of the two edges within the triangle's plane: dot(dual1, edge1) = 1, dot(dual1, edge2) = 0, ...
+    glm::vec3 dual1 = glm::cross(edge2, normal) / area2;
+    glm::vec3 dual2 = glm::cross(normal, edge1) / area2;
+
+    glm::vec3 du = uvEdge1.x * dual1 + uvEdge2.x * dual2;
+    glm::vec3 dv = uvEdge1.y * dual1 + uvEdge2.y * dual2;
+
+    return std::make_tuple(du, dv);
+
+}
+
+// Returns the triangle closest to point, along with the barycentric coordinates of point on it.
+int Mesh::findFace(const glm::vec3& point, glm::vec2& barycentric) const {
+
+    const MeshData &data = m_mesh->data;
+
+    int closest = 0;
+    float closestDistance = INFINITY;
+    barycentric = glm::vec2(0.0f);
+
+    for (int index = 0; index < (int)data.triangles.size(); index++) {
+
+        const glm::ivec3 &triangle = data.triangles[index];
+        glm::vec3 p0 = data.positions[triangle[0]];
+        glm::vec3 edge1 = data.positions[triangle[1]] - p0;
+        glm::vec3 edge2 = data.positions[triangle[2]] - p0;
+
+        glm::vec3 normal = glm::cross(edge1, edge2);
+        float area2 = glm::dot(normal, normal);
+        if (area2 == 0.0f) continue;
+
+        glm::vec3 toPoint = point - p0;
+        glm::vec2 weights(glm::dot(glm::cross(toPoint, edge2), normal) / area2,
+                          glm::dot(glm::cross(edge1, toPoint), normal) / area2);
+
+        // Distance off the plane, plus how far the projection lies outside the triangle.
+        float outside = glm::max(0.0f, -weights.x) + glm::max(0.0f, -weights.y) + glm::max(0.0f, weights.x + weights.y - 1.0f);
+        float distance = std::abs(glm::dot(toPoint, normal)) / std::sqrt(area2) + outside * std::sqrt(std::sqrt(area2));
+
+        if (distance < closestDistance) {
+            closestDistance = distance;
+            closest = index;
+            barycentric = weights;
+        }
+
+    }
+
+    return closest;
+
+}
+
+glm::vec3 Mesh::computeNormal(glm::vec3& hitPoint) const {
+
+    glm::vec2 barycentric;
+    int face = findFace(hitPoint, barycentric);
+
+    return computeNormal(hitPoint, face, barycentric);
+
+}
+
+glm::vec2 Mesh::computeUV(glm::vec3& hitPoint) const {
+
+    glm::vec2 barycentric;
+    int face = findFace(hitPoint, barycentric);
+
+    return computeUV(hitPoint, face, barycentric);
+
+}
+
+std::tuple<glm::vec3, glm::vec3> Mesh::computeDifferentials(glm::vec3& hitPoint) const {
+
+    glm::vec2 barycentric;
+    int face = findFace(hitPoint, barycentric);
+
+    return computeDifferentials(hitPoint, face, barycentric);
+
+}
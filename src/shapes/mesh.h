@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include "camera/camera.h"
+#include "raytracer/bvh.h"
+#include "shape.h"
+#include "utils/objreader.h"
+
+// The triangles of one OBJ file and a BVH over them, both in object space.
+// A file is loaded once and shared by every Mesh that instances it; instances only add their CTM.
+struct TriangleMesh {
+    MeshData data;
+    BVH bvh;
+    AABB bounds;
+
+    // Returns the mesh of file, reading it and building its BVH on first use.
+    // Returns nullptr if the file cannot be read.
+    static std::shared_ptr<const TriangleMesh> load(const std::string &file);
+};
+
+class Mesh : public Shape {
+
+public:
+
+    Mesh(std::shared_ptr<const TriangleMesh> mesh) : m_mesh(std::move(mesh)) {}
+
+    bool rayIntersect (
+        const Ray& ray,
+        float& t,
+        glm::vec3& hitPoint) const override;
+
+    bool occluded(const Ray& ray, float tMax) const override;
+
+    // Kernels behind rayIntersect and occluded, used directly by the flat scene arrays.
+    // closestHit also reports the triangle that was hit and the barycentric coordinates of the hit on it.
+    bool closestHit(const Ray& ray, float& t, int& face, glm::vec2& barycentric) const;
+    bool anyHit(const Ray& ray, float tMax) const;
+
+    // Interpolate the vertex normals and UVs of the given face.
+    glm::vec3 computeNormal(glm::vec3& hitPoint, int face, glm::vec2 barycentric) const override;
+    glm::vec2 computeUV(glm::vec3& hitPoint, int face, glm::vec2 barycentric) const override;
+    std::tuple<glm::vec3, glm::vec3> computeDifferentials(glm::vec3& hitPoint, int face, glm::vec2 barycentric) const override;
+
+    // Without a face these first search every triangle for the one containing hitPoint.
+    glm::vec3 computeNormal(glm::vec3& hitPoint) const override;
+    glm::vec2 computeUV( glm::vec3& hitPoint ) const override;
+    std::tuple<glm::vec3, glm::vec3> computeDifferentials( glm::vec3& hitPoint ) const override;
+
+    AABB objectBounds() const override { return m_mesh->bounds; }
+
+private:
+    std::shared_ptr<const TriangleMesh> m_mesh;
+
+    static bool intersectTriangle(const Ray& ray, const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2,
+                                  float& t, glm::vec2& barycentric);
+
+    int findFace(const glm::vec3& point, glm::vec2& barycentric) const;
+
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include "camera/camera.h"
+
+// Fixed-width SIMD types for intersecting several rays at once.
+// AVX2 builds use 8 lanes, SSE2 builds 4, and everything else (or RAY_DISABLE_SIMD) falls back
+// to plain 4-lane arrays that the compiler is free to vectorize on its own.
+// min and max follow the SSE rule: when either operand is NaN, the second one is returned.
+
+#if defined(__AVX2__) && !defined(RAY_DISABLE_SIMD)
+#include <immintrin.h>
+#define RAY_PACKET_AVX2
+#define RAY_PACKET_WIDTH 8
+#elif (defined(__SSE2__) || defined(_M_X64)) && !defined(RAY_DISABLE_SIMD)
+#include <emmintrin.h>
+#define RAY_PACKET_SSE2
+#define RAY_PACKET_WIDTH 4
+#else
+#define RAY_PACKET_WIDTH 4
+#endif
+
+#if defined(RAY_PACKET_AVX2)
+
+struct PacketMask {
+    __m256 v;
+
+    PacketMask operator&(PacketMask o) const { return {_mm256_and_ps(v, o.v)}; }
+    PacketMask operator|(PacketMask o) const { return {_mm256_or_ps(v, o.v)}; }
+    PacketMask operator!() const { return {_mm256_xor_ps(v, _mm256_castsi256_ps(_mm256_set1_epi32(-1)))}; }
+
+    bool any() const { return _mm256_movemask_ps(v) != 0; }
+    bool lane(int i) const { return (_mm256_movemask_ps(v) >> i) & 1; }
+};
+
+struct PacketFloat {
+    __m256 v;
+
+    PacketFloat() : v(_mm256_setzero_ps()) {}
+    PacketFloat(__m256 x) : v(x) {}
+    PacketFloat(float x) : v(_mm256_set1_ps(x)) {}
+
+    static PacketFloat load(const float *p) { return {_mm256_loadu_ps(p)}; }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+
+    PacketFloat operator+(PacketFloat o) const { return {_mm256_add_ps(v, o.v)}; }
+    PacketFloat operator-(PacketFloat o) const { return {_mm256_sub_ps(v, o.v)}; }
+    PacketFloat operator*(PacketFloat o) const { return {_mm256_mul_ps(v, o.v)}; }
+    PacketFloat operator/(PacketFloat o) const { return {_mm256_div_ps(v, o.v)}; }
+    PacketFloat operator-() const { return {_mm256_xor_ps(v, _mm256_set1_ps(-0.0f))}; }
+
+    PacketMask operator<(PacketFloat o) const { return {_mm256_cmp_ps(v, o.v, _CMP_LT_OQ)}; }
+    PacketMask operator>(PacketFloat o) const { return {_mm256_cmp_ps(v, o.v, _CMP_GT_OQ)}; }
+    PacketMask operator<=(PacketFloat o) const { return {_mm256_cmp_ps(v, o.v, _CMP_LE_OQ)}; }
+    PacketMask operator>=(PacketFloat o) const { return {_mm256_cmp_ps(v, o.v, _CMP_GE_OQ)}; }
+    PacketMask operator!=(PacketFloat o) const { return {_mm256_cmp_ps(v, o.v, _CMP_NEQ_UQ)}; }
+};
+
+inline PacketFloat min(PacketFloat a, PacketFloat b) { return {_mm256_min_ps(a.v, b.v)}; }
+inline PacketFloat max(PacketFloat a, PacketFloat b) { return {_mm256_max_ps(a.v, b.v)}; }
+inline PacketFloat sqrt(PacketFloat a) { return {_mm256_sqrt_ps(a.v)}; }
+inline PacketFloat select(PacketMask m, PacketFloat a, PacketFloat b) { return {_mm256_blendv_ps(b.v, a.v, m.v)}; }
+
+#elif defined(RAY_PACKET_SSE2)
+
+struct PacketMask {
+    __m128 v;
+
+    PacketMask operator&(PacketMask o) const { return {_mm_and_ps(v, o.v)}; }
+    PacketMask operator|(PacketMask o) const { return {_mm_or_ps(v, o.v)}; }
+    PacketMask operator!() const { return {_mm_xor_ps(v, _mm_castsi128_ps(_mm_set1_epi32(-1)))}; }
+
+    bool any() const { return _mm_movemask_ps(v) != 0; }
+    bool lane(int i) const { return (_mm_movemask_ps(v) >> i) & 1; }
+};
+
+struct PacketFloat {
+    __m128 v;
+
+    PacketFloat() : v(_mm_setzero_ps()) {}
+    PacketFloat(__m128 x) : v(x) {}
+    PacketFloat(float x) : v(_mm_set1_ps(x)) {}
+
+    static PacketFloat load(const float *p) { return {_mm_loadu_ps(p)}; }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+
+    PacketFloat operator+(PacketFloat o) const { return {_mm_add_ps(v, o.v)}; }
+    PacketFloat operator-(PacketFloat o) const { return {_mm_sub_ps(v, o.v)}; }
+    PacketFloat operator*(PacketFloat o) const { return {_mm_mul_ps(v, o.v)}; }
+    PacketFloat operator/(PacketFloat o) const { return {_mm_div_ps(v, o.v)}; }
+    PacketFloat operator-() const { return {_mm_xor_ps(v, _mm_set1_ps(-0.0f))}; }
+
+    PacketMask operator<(PacketFloat o) const { return {_mm_cmplt_ps(v, o.v)}; }
+    PacketMask operator>(PacketFloat o) const { return {_mm_cmpgt_ps(v, o.v)}; }
+    PacketMask operator<=(PacketFloat o) const { return {_mm_cmple_ps(v, o.v)}; }
+    PacketMask operator>=(PacketFloat o) const { return {_mm_cmpge_ps(v, o.v)}; }
+    PacketMask operator!=(PacketFloat o) const { return {_mm_cmpneq_ps(v, o.v)}; }
+};
+
+inline PacketFloat min(PacketFloat a, PacketFloat b) { return {_mm_min_ps(a.v, b.v)}; }
+inline PacketFloat max(PacketFloat a, PacketFloat b) { return {_mm_max_ps(a.v, b.v)}; }
+inline PacketFloat sqrt(PacketFloat a) { return {_mm_sqrt_ps(a.v)}; }
+inline PacketFloat select(PacketMask m, PacketFloat a, PacketFloat b) {
+    return {_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))};
+}
+
+#else
+
+struct PacketMask {
+    bool v[RAY_PACKET_WIDTH];
+
+    PacketMask operator&(PacketMask o) const { PacketMask r; for (int i = 0; i < RAY_PACKET_WIDTH; i++) r.v[i] = v[i] && o.v[i]; return r; }
+    PacketMask operator|(PacketMask o) const { PacketMask r; for (int i = 0; i < RAY_PACKET_WIDTH; i++) r.v[i] = v[i] || o.v[i]; return r; }
+    PacketMask operator!() const { PacketMask r; for (int i = 0; i < RAY_PACKET_WIDTH; i++) r.v[i] = !v[i]; return r; }
+
+    bool any() const { for (int i = 0; i < RAY_PACKET_WIDTH; i++) if (v[i]) return true; return false; }
+    bool lane(int i) const { return v[i]; }
+};
+
+struct PacketFloat {
+    float v[RAY_PACKET_WIDTH];
+
+    PacketFloat() : PacketFloat(0.0f) {}
+    PacketFloat(float x) { for (int i = 0; i < RAY_PACKET_WIDTH; i++) v[i] = x; }
+
+    static PacketFloat load(const float *p) { PacketFloat r; for (int i = 0; i < RAY_PACKET_WIDTH; i++) r.v[i] = p[i]; return r; }
+    void store(float *p) const { for (int i = 0; i < RAY_PACKET_WIDTH; i++) p[i] = v[i]; }
+
+#define RAY_PACKET_BINARY(op) \
+    PacketFloat operator op(PacketFloat o) const { PacketFloat r; for (int i = 0; i < RAY_PACKET_WIDTH; i++) r.v[i] = v[i] op o.v[i]; return r; }
+#define RAY_PACKET_COMPARE(op) \
+    PacketMask operator op(PacketFloat o) const { PacketMask r; for (int i = 0; i < RAY_PACKET_WIDTH; i++) r.v[i] = v[i] op o.v[i]; return r; }
+
+    RAY_PACKET_BINARY(+)
+    RAY_PACKET_BINARY(-)
+    RAY_PACKET_BINARY(*)
+    RAY_PACKET_BINARY(/)
+    RAY_PACKET_COMPARE(<)
+    RAY_PACKET_COMPARE(>)
+    RAY_PACKET_COMPARE(<=)
+    RAY_PACKET_COMPARE(>=)
+    RAY_PACKET_COMPARE(!=)
+
+#undef RAY_PACKET_BINARY
+#undef RAY_PACKET_COMPARE
+
+    PacketFloat operator-() const { PacketFloat r; for (int i = 0; i < RAY_PACKET_WIDTH; i++) r.v[i] = -v[i]; return r; }
+};
+
+inline PacketFloat min(PacketFloat a, PacketFloat b) { PacketFloat r; for (int i = 0; i < RAY_PACKET_WIDTH; i++) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r; }
+inline PacketFloat max(PacketFloat a, PacketFloat b) { PacketFloat r; for (int i = 0; i < RAY_PACKET_WIDTH; i++) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r; }
+inline PacketFloat sqrt(PacketFloat a) { PacketFloat r; for (int i = 0; i < RAY_PACKET_WIDTH; i++) r.v[i] = std::sqrt(a.v[i]); return r; }
+inline PacketFloat select(PacketMask m, PacketFloat a, PacketFloat b) { PacketFloat r; for (int i = 0; i < RAY_PACKET_WIDTH; i++) r.v[i] = m.v[i] ? a.v[i] : b.v[i]; return r; }
+
+#endif
+
+// Transforms packed points and vectors by m. The sums are grouped like glm's mat4 * vec4, so each
+// lane comes out bit-identical to the scalar transform.
+inline void transformPoint(const glm::mat4 &m, PacketFloat &x, PacketFloat &y, PacketFloat &z) {
+    PacketFloat tx = (PacketFloat(m[0][0]) * x + PacketFloat(m[1][0]) * y) + (PacketFloat(m[2][0]) * z + PacketFloat(m[3][0]));
+    PacketFloat ty = (PacketFloat(m[0][1]) * x + PacketFloat(m[1][1]) * y) + (PacketFloat(m[2][1]) * z + PacketFloat(m[3][1]));
+    PacketFloat tz = (PacketFloat(m[0][2]) * x + PacketFloat(m[1][2]) * y) + (PacketFloat(m[2][2]) * z + PacketFloat(m[3][2]));
+    x = tx;
+    y = ty;
+    z = tz;
+}
+
+inline void transformVector(const glm::mat4 &m, PacketFloat &x, PacketFloat &y, PacketFloat &z) {
+    PacketFloat tx = (PacketFloat(m[0][0]) * x + PacketFloat(m[1][0]) * y) + PacketFloat(m[2][0]) * z;
+    PacketFloat ty = (PacketFloat(m[0][1]) * x + PacketFloat(m[1][1]) * y) + PacketFloat(m[2][1]) * z;
+    PacketFloat tz = (PacketFloat(m[0][2]) * x + PacketFloat(m[1][2]) * y) + PacketFloat(m[2][2]) * z;
+    x = tx;
+    y = ty;
+    z = tz;
+}
+
+// A packet of rays in structure-of-arrays form. Inactive lanes are ignored by every kernel.
+struct RayPacket {
+    PacketFloat originX, originY, originZ;
+    PacketFloat directionX, directionY, directionZ;
+    PacketMask active;
+
+    // Packs up to RAY_PACKET_WIDTH rays. Lanes past count repeat the first ray and are inactive.
+    static RayPacket gather(const Ray *rays, int count) {
+        float lanes[7][RAY_PACKET_WIDTH];
+        for (int i = 0; i < RAY_PACKET_WIDTH; i++) {
+            const Ray &ray = rays[i < count ? i : 0];
+            lanes[0][i] = ray.origin.x;
+            lanes[1][i] = ray.origin.y;
+            lanes[2][i] = ray.origin.z;
+            lanes[3][i] = ray.direction.x;
+            lanes[4][i] = ray.direction.y;
+            lanes[5][i] = ray.direction.z;
+            lanes[6][i] = (float)i;
+        }
+        RayPacket r;
+        r.originX = PacketFloat::load(lanes[0]);
+        r.originY = PacketFloat::load(lanes[1]);
+        r.originZ = PacketFloat::load(lanes[2]);
+        r.directionX = PacketFloat::load(lanes[3]);
+        r.directionY = PacketFloat::load(lanes[4]);
+        r.directionZ = PacketFloat::load(lanes[5]);
+        r.active = PacketFloat::load(lanes[6]) < PacketFloat((float)count);
+        return r;
+    }
+
+    // Transforms every ray of the packet by m (points for origins, vectors for directions).
+    RayPacket transformed(const glm::mat4 &m) const {
+        RayPacket r = *this;
+        transformPoint(m, r.originX, r.originY, r.originZ);
+        transformVector(m, r.directionX, r.directionY, r.directionZ);
+        return r;
+    }
+};
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <memory>
 #include "camera/camera.h"
 #include "textures/texture.h"
+#include "utils/aabb.h"
 #include "utils/imagereader.h"
 #include "utils/sceneparser.h"
 
@@ -17,17 +19,35 @@ public:
         float& t,
         glm::vec3& hitPoint) const = 0;
 
+    // Returns true if the ray hits the shape anywhere in (0, tMax).
+    // Only answers yes/no, so implementations can stop at the first surface they find.
+    virtual bool occluded(const Ray& ray, float tMax) const {
+        float t; glm::vec3 hitPoint;
+        return rayIntersect(ray, t, hitPoint) && t < tMax;
+    }
+
     virtual glm::vec3 computeNormal(glm::vec3& hitPoint ) const = 0;
     virtual glm::vec2 computeUV( glm::vec3& hitPoint ) const = 0;
     virtual std::tuple<glm::vec3, glm::vec3> computeDifferentials( glm::vec3& hitPoint ) const = 0;
 
+    // Versions for shapes built from many faces (meshes), which also need the face that was hit and the
+    // barycentric coordinates of the hit on it. The analytic primitives only look at the hit point.
+    virtual glm::vec3 computeNormal(glm::vec3& hitPoint, int face, glm::vec2 barycentric) const { return computeNormal(hitPoint); }
+    virtual glm::vec2 computeUV(glm::vec3& hitPoint, int face, glm::vec2 barycentric) const { return computeUV(hitPoint); }
+    virtual std::tuple<glm::vec3, glm::vec3> computeDifferentials(glm::vec3& hitPoint, int face, glm::vec2 barycentric) const {
+        return computeDifferentials(hitPoint);
+    }
+
+    // Object space bounds; every primitive fits in the unit cube unless it says otherwise.
+    virtual AABB objectBounds() const { return AABB{glm::vec3(-0.5f), glm::vec3(0.5f)}; }
+
     RenderShapeData shapeInfo;
     glm::mat4 inverseCTM;
-    Texture texture;
+    std::shared_ptr<const Texture> texture; // Shared with every shape using the same texture map; null if untextured
 
 protected:
 
-    float discriminant(float a, float b, float c) const {
+    static float discriminant(float a, float b, float c) {
         return b * b - 4 * a * c;
     }
 
@@ -2,11 +2,11 @@
 #include <glm/glm.hpp>
 #include <algorithm>
 
-bool Sphere::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
+bool Sphere::closestHit(const Ray& ray, float& t, float radius) {
 
     float a = glm::dot(ray.direction, ray.direction);
     float b = 2.0f * glm::dot(ray.origin, ray.direction);
-    float c = glm::dot(ray.origin, ray.origin) - (m_radius * m_radius);
+    float c = glm::dot(ray.origin, ray.origin) - (radius * radius);
 
     float d = discriminant(a, b, c);
     if (d < 0) return false;
@@ -17,9 +17,58 @@ bool Sphere::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
     if (t1 < 0 && t2 < 0) return false;
 
     t = (t1 > 0 && t2 > 0) ? std::min(t1, t2) : std::max(t1, t2);
-    hitPoint = ray.origin + t * ray.direction;
+    return true;
+}
+
+bool Sphere::anyHit(const Ray& ray, float tMax, float radius) {
+
+    float a = glm::dot(ray.direction, ray.direction);
+    float b = 2.0f * glm::dot(ray.origin, ray.direction);
+    float c = glm::dot(ray.origin, ray.origin) - (radius * radius);
+
+    float d = discriminant(a, b, c);
+    if (d < 0) return false;
+
+    float t1 = (-b - glm::sqrt(d)) / (2 * a);
+    float t2 = (-b + glm::sqrt(d)) / (2 * a);
+
+    return (t1 > 0 && t1 < tMax) || (t2 > 0 && t2 < tMax);
+
+}
+
+PacketMask Sphere::closestHit(const RayPacket& ray, PacketFloat& t, float radius) {
 
+    PacketFloat a = ray.directionX * ray.directionX + ray.directionY * ray.directionY + ray.directionZ * ray.directionZ;
+    PacketFloat b = PacketFloat(2.0f) * (ray.originX * ray.directionX + ray.originY * ray.directionY + ray.originZ * ray.directionZ);
+    PacketFloat c = (ray.originX * ray.originX + ray.originY * ray.originY + ray.originZ * ray.originZ) - PacketFloat(radius * radius);
+
+    PacketFloat d = b * b - PacketFloat(4.0f) * a * c;
+    PacketMask hit = ray.active & !(d < PacketFloat(0.0f));
+
+    PacketFloat sqrtD = sqrt(max(d, PacketFloat(0.0f)));
+    PacketFloat t1 = (-b + sqrtD) / (PacketFloat(2.0f) * a);
+    PacketFloat t2 = (-b - sqrtD) / (PacketFloat(2.0f) * a);
+
+    hit = hit & !((t1 < PacketFloat(0.0f)) & (t2 < PacketFloat(0.0f)));
+
+    PacketMask bothAhead = (t1 > PacketFloat(0.0f)) & (t2 > PacketFloat(0.0f));
+    t = select(bothAhead, min(t1, t2), max(t2, t1));
+
+    return hit;
+
+}
+
+bool Sphere::rayIntersect(const Ray& ray, float& t, glm::vec3& hitPoint) const {
+
+    if (!closestHit(ray, t, m_radius)) return false;
+
+    hitPoint = ray.origin + t * ray.direction;
     return true;
+
+}
+
+bool Sphere::occluded(const Ray& ray, float tMax) const {
+    return anyHit(ray, tMax, m_radius);
 }
 
 glm::vec3 Sphere::computeNormal(glm::vec3& hitPoint) const {
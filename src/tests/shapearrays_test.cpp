@@ -0,0 +1,69 @@
+#include "raytracer/shapearrays.h"
+#include "shapes/cube.h"
+#include <glm/gtx/transform.hpp>
+
+#include <cmath>
+#include <iostream>
+
+// Checks that the bounding volumes of ShapeArrays never reject a ray that hits the shape.
+// Returns the number of failed checks, so ctest fails on any of them.
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char *what) {
+
+    if (condition) return;
+
+    std::cerr << "FAILED: " << what << std::endl;
+    failures++;
+
+}
+
+// A unit cube stretched along x after a 45 degree turn about z. Its corners at (+-1.41, 0, +-0.5) lie 1.5 from
+// its centre, further than half its object diagonal times its longest CTM column (1.37).
+std::shared_ptr<Shape> rotatedStretchedCube() {
+
+    auto cube = std::make_shared<Cube>();
+    cube->shapeInfo.primitive.type = PrimitiveType::PRIMITIVE_CUBE;
+    cube->shapeInfo.ctm = glm::scale(glm::vec3(2.0f, 1.0f, 1.0f)) * glm::rotate(glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    cube->inverseCTM = glm::inverse(cube->shapeInfo.ctm);
+
+    return cube;
+
+}
+
+} // namespace
+
+int main() {
+
+    ShapeArrays arrays;
+    arrays.build({rotatedStretchedCube()});
+
+    // Down the z axis, 1.38 out along x: inside the cube's stretched edge but outside the old bounding sphere.
+    Ray ray {glm::vec3(1.38f, 0.0f, 5.0f), glm::vec3(0.0f, 0.0f, -1.0f)};
+
+    ShapeHit hit;
+    arrays.intersectAll(ray, hit);
+    check(hit.shapeIndex == 0 && std::abs(hit.t - 4.5f) < 1e-4f, "ray near a stretched edge hits the cube");
+
+    check(arrays.occluded(0, ray, 10.0f), "ray near a stretched edge is occluded by the cube");
+
+    Ray rays[RAY_PACKET_WIDTH];
+    for (Ray &lane : rays) lane = ray;
+
+    RayPacket packet = RayPacket::gather(rays, RAY_PACKET_WIDTH);
+    PacketHit packetHit;
+    arrays.intersectAll(packet, packetHit);
+
+    for (int lane = 0; lane < RAY_PACKET_WIDTH; lane++) {
+        check(packetHit.lanes[lane].shapeIndex == 0 && std::abs(packetHit.lanes[lane].t - 4.5f) < 1e-4f,
+              "packet lane near a stretched edge hits the cube");
+    }
+
+    if (failures == 0) std::cout << "All ShapeArrays checks passed" << std::endl;
+
+    return failures;
+
+}
@@ -1,18 +1,103 @@
 #include "texture.h"
+#include "texturecache.h"
+#include "raytracer/tilescheduler.h"
+#include "shapes/packet.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <tuple>
 
-Texture::Texture() : texture(nullptr), blend(0.0f) { info = SceneFileMap(); }
+Texture::Texture(ImagePtr image,
+                 SceneFileMap i) : info(i) {
 
-Texture::Texture(Image* text,
-                 SceneFileMap i,
-                 float b) : texture(text),
-                 info(i),
-                 blend(b) {}
+    m_levels.push_back(toBlocks(std::move(image)));
+    texture = m_levels[0].get();
+
+}
+
+Texture::Texture(std::vector<ImagePtr> levels,
+                 std::unique_ptr<QFile> mapping,
+                 SceneFileMap i) : info(i),
+                 m_levels(std::move(levels)),
+                 m_mapping(std::move(mapping)) {
+
+    texture = m_levels[0].get();
+
+}
+
+Texture::~Texture() = default;
+
+// Textures that are currently loaded, by file name and repeat settings. Entries expire with the last shape using them.
+// The cache lock only guards the map; each entry has a lock of its own, held while its texture is built, so loads of
+// different files run in parallel and loads of the same file wait for the first one.
+struct TextureCacheEntry {
+    std::mutex mutex;
+    std::weak_ptr<const Texture> texture;
+};
+
+static std::mutex textureCacheMutex;
+static std::map<std::tuple<std::string, float, float>, std::shared_ptr<TextureCacheEntry>> textureCache;
+
+std::shared_ptr<const Texture> Texture::load(const SceneFileMap& map, int threadCount) {
+
+    std::shared_ptr<TextureCacheEntry> entry;
+
+    {
+        std::lock_guard<std::mutex> lock(textureCacheMutex);
+
+        std::shared_ptr<TextureCacheEntry> &slot = textureCache[std::make_tuple(map.filename, map.repeatU, map.repeatV)];
+        if (!slot) slot = std::make_shared<TextureCacheEntry>();
+        entry = slot;
+    }
+
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (std::shared_ptr<const Texture> cached = entry->texture.lock()) return cached;
+
+    std::shared_ptr<Texture> texture;
+    std::vector<ImagePtr> levels;
+
+    if (std::unique_ptr<QFile> mapping = TextureCache::map(map.filename, levels)) {
+
+        texture = std::shared_ptr<Texture>(new Texture(std::move(levels), std::move(mapping), map));
+
+    } else {
+
+        ImagePtr image(loadImageFromFile(map.filename));
+        if (!image) return nullptr;
+
+        texture = std::make_shared<Texture>(std::move(image), map);
+        texture->generateMaps(threadCount);
+        TextureCache::store(map.filename, texture->m_levels);
+
+    }
+
+    entry->texture = texture;
+
+    return texture;
+
+}
 
 //                                                  === HELPERS ===
 inline int pointToIndex(int i, int j, int width) {
 
     return j * width + i;
 
+}
+// Index of texel (i, j) in a level stored as TEXTURE_BLOCK_SIZE x TEXTURE_BLOCK_SIZE blocks, which are laid
+// out row by row and hold their own texels row by row. The last row and column of blocks may be partly unused.
+inline int texelIndex(int i, int j, int width) {
+
+    int blocksX = (width + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+    int block = (j / TEXTURE_BLOCK_SIZE) * blocksX + i / TEXTURE_BLOCK_SIZE;
+
+    return block * TEXTURE_BLOCK_SIZE * TEXTURE_BLOCK_SIZE + (j % TEXTURE_BLOCK_SIZE) * TEXTURE_BLOCK_SIZE + i % TEXTURE_BLOCK_SIZE;
+
+}
+inline RGBA* allocateBlocks(int width, int height) {
+
+    return new RGBA[Texture::storageSize(width, height)];
+
 }
 inline RGBA toRGBA(const glm::vec4 &illumination) {
 
@@ -38,158 +123,208 @@ glm::vec4 toFloat(const RGBA &illumination) {
 
 
 //                                                  === TEXTURE HANDLING ===
-void Texture::generateMaps() {
+int Texture::storageSize(int width, int height) {
+
+    int blocksX = (width + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+    int blocksY = (height + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+
+    return blocksX * blocksY * TEXTURE_BLOCK_SIZE * TEXTURE_BLOCK_SIZE;
+
+}
+
+// Rearranges a row-major image into blocks.
+ImagePtr Texture::toBlocks(ImagePtr image) {
+
+    if (TEXTURE_BLOCK_SIZE == 1) return image;
+
+    RGBA* data = allocateBlocks(image->width, image->height);
+    for (int j = 0; j < image->height; j++) {
+        for (int i = 0; i < image->width; i++) {
+            data[texelIndex(i, j, image->width)] = image->data[pointToIndex(i, j, image->width)];
+        }
+    }
 
-    m_levels = std::vector<Image*>();
+    return ImagePtr(new Image{data, image->width, image->height});
+
+}
+
+void Texture::generateMaps(int threadCount) {
+
+    // Level 0 is the image itself.
+    m_levels.resize(1);
 
     float levels = glm::max(glm::ceil(glm::log2((float)texture->height)),
                             glm::ceil(glm::log2((float)texture->width)));
 
-    for (int level = 0; level <= levels; level++) {
+    // Every level is filtered from the one above it, kept in float so rounding does not build up down the chain.
+    // Level 1 reads the image bytes directly rather than a float copy of the image, so the float buffers are the
+    // level being built and the one above it: at most levels 1 and 2, 256MB and 64MB for an 8K texture.
+    int previousWidth = texture->width;
+    int previousHeight = texture->height;
+    std::vector<float> previous;
 
+    for (int level = 1; level <= levels; level++) {
 
         int width = std::max(1.0, texture->width / glm::pow(2.0, level));
         int height = std::max(1.0, texture->height / glm::pow(2.0, level));
 
+        std::vector<float> current = downsample(level == 1 ? texture : nullptr, previous, previousWidth, previousHeight, width, height,
+                                               threadCount);
 
-        if (level == 0) {
+        RGBA* data = allocateBlocks(width, height);
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                const float* color = &current[4 * pointToIndex(i, j, width)];
+                data[texelIndex(i, j, width)] = toRGBA(glm::vec4(color[0], color[1], color[2], color[3]));
+            }
+        }
+        m_levels.push_back(ImagePtr(new Image{data, width, height}));
 
-            m_levels.push_back(texture);
+        if (width == 1 && height == 1) break;
 
-        } else {
+        previous = std::move(current);
+        previousWidth = width;
+        previousHeight = height;
 
-            float scaleFactorX = (float)width / texture->width;
-            float scaleFactorY = (float)height / texture->height;
-            Image* downsampledImage = downsample(scaleFactorX, scaleFactorY, width, height);
-            m_levels.push_back(downsampledImage);
+    }
 
-        }
+}
 
-        if (width == 1 && height == 1) break;
+float filter(float x, float radius) {
 
-    }
+    if (x < -radius || x > radius) return 0;
+    else return (1 - fabs(x) / radius);
 
 }
 
-Image* Texture::downsample(float& scaleX, float& scaleY, int& width, int& height) {
+// Tent filter taps that resample a row (or column) of sourceSize texels to targetSize texels.
+// The texture repeats, so taps that fall off either edge wrap around to the other side.
+Texture::FilterTaps Texture::filterTaps(int sourceSize, int targetSize) {
 
-    std::vector<RGBA> horizontal = std::vector<RGBA>(width * texture->height);
-    std::vector<RGBA> vertical = std::vector<RGBA>(width * height);
-    std::vector<RGBA> textureData(texture->data, texture->data + texture->width * texture->height);
+    FilterTaps taps;
+    taps.first.push_back(0);
 
-    // Horizontal Pass --
-    for (int j = 0; j < texture->height; j++) {
-        for (int i = 0; i < width; i++) {
+    float a = (float)targetSize / sourceSize;
+    float radius = (a < 1.0f) ? (1.0f / a) : 1.0f;
 
-            int index = pointToIndex(i, j, width);
-            horizontal[index] = toRGBA(tent(i, scaleX, textureData, j, i, texture->width, texture->height, true));
+    for (int k = 0; k < targetSize; k++) {
 
-        }
-    }
+        float center = ((float)k + 0.5f) / a - 0.5f;
 
-    RGBA* data = new RGBA[width * height];
+        int left = std::max((int)std::floor(center - radius), -1);
+        int right = std::min((int)std::ceil(center + radius), sourceSize);
 
-    // Vertical Pass --
-    for (int j = 0; j < height; j++) {
-        for (int i = 0; i < width; i++) {
+        float weightSum = 0.0f;
+        int begin = (int)taps.weights.size();
 
-            int index = pointToIndex(i, j, width);
-            RGBA color = toRGBA(tent(j, scaleY, horizontal, j, i, width, texture->height, false));
-            vertical[index] = color;
-            data[index] = color;
+        for (int s = left; s <= right; s++) {
+
+            float w = filter((float)(s - center), radius);
+            if (w <= 0.0f) continue;
+
+            taps.sources.push_back(((s % sourceSize) + sourceSize) % sourceSize);
+            taps.weights.push_back(w);
+            weightSum += w;
 
         }
-    }
 
+        if (weightSum > 0.0f) {
+            for (int tap = begin; tap < (int)taps.weights.size(); tap++) taps.weights[tap] /= weightSum;
+        }
+        taps.first.push_back((int)taps.weights.size());
 
-    // // DEBUG
-    // QImage imgH(width, texture->height, QImage::Format_RGBA8888);
-    // for (int row = 0; row < texture->height; row++) {  // Original height
-    //     for (int col = 0; col < width; col++) {        // Scaled width
-    //         int index = col + row * width;  // Direct calculation, clear order
-    //         RGBA pixel = horizontal[index];
-    //         imgH.setPixelColor(col, row, QColor(pixel.r, pixel.g, pixel.b, pixel.a));
-    //     }
-    // }
+    }
 
-    // std::string filenameH = "debug_hpass_" + std::to_string(scaleX) + ".png";
-    // imgH.save(QString::fromStdString(filenameH));
+    return taps;
 
-    // // Save final vertical pass result
-    // QImage img(width, height, QImage::Format_RGBA8888);
-    // for (int row = 0; row < height; row++) {  // Final height
-    //     for (int col = 0; col < width; col++) { // Final width
-    //         int index = col + row * width;
-    //         RGBA pixel = vertical[index];
-    //         img.setPixelColor(col, row, QColor(pixel.r, pixel.g, pixel.b, pixel.a));
-    //     }
-    // }
+}
 
-    // std::string filename = "debug_final_" + std::to_string(scaleX) + "x" + std::to_string(scaleY) + ".png";
-    // img.save(QString::fromStdString(filename));
+// Resamples a width x height RGBA image to targetWidth x targetHeight floats, one axis at a time.
+// The source is image if given, otherwise source holds it in float. Large levels are split into strips of
+// TEXTURE_TILE_SIZE output rows and filtered on up to threadCount threads.
+std::vector<float> Texture::downsample(const Image* image, const std::vector<float>& source, int width, int height,
+                                       int targetWidth, int targetHeight, int threadCount) {
 
+    FilterTaps columnTaps = filterTaps(height, targetHeight);
+    FilterTaps rowTaps = filterTaps(width, targetWidth);
 
-    Image* result = new Image{data, width, height};
-    return result;
+    if (width * height < TEXTURE_PARALLEL_PIXELS) threadCount = 1;
 
-}
+    std::vector<float> result(4 * targetWidth * targetHeight);
 
-// Takes vec4 color values and returns the blended version.
-glm::vec4 lerp(glm::vec4 a, glm::vec4 b, float weight) {
+    // Tiles one column wide, so each is a strip of output rows across the whole level.
+    TileScheduler(1, targetHeight, TEXTURE_TILE_SIZE, threadCount).run([&](const Tile &tile) {
 
-    return (1 - weight) * a + weight * b;
+        // Each output row is filtered vertically into a source-wide row of scratch, then horizontally into the
+        // result, so the strip never holds more than a row of the level in between.
+        std::vector<float> vertical(4 * width);
+        std::vector<float> scratch(image ? 4 * width : 0);
 
-}
+        // Source rows as floats; rows of an image are converted into scratch.
+        auto sourceRow = [&](int row) -> const float* {
 
-float filter(float x, float radius) {
+            if (!image) return &source[4 * width * row];
 
-    if (x < -radius || x > radius) return 0;
-    else return (1 - fabs(x) / radius);
+            for (int i = 0; i < width; i++) {
+                glm::vec4 color = toFloat(image->data[texelIndex(i, row, width)]);
+                for (int channel = 0; channel < 4; channel++) scratch[4 * i + channel] = color[channel];
+            }
+            return scratch.data();
 
-}
+        };
 
+        for (int j = tile.y0; j < tile.y1; j++) {
 
-glm::vec4 Texture::tent(int& k, float& a, std::vector<RGBA>& f, int& row, int& col, int fWidth, int fHeight, bool horizontal) {
+            // Vertical Pass --
+            // The row is a weighted sum of whole source rows, so the packet loop runs straight along them.
+            float* out = vertical.data();
+            std::fill(vertical.begin(), vertical.end(), 0.0f);
 
-    glm::vec4 sum(0.0f);
-    float weights_sum = 0.0f;
+            for (int tap = columnTaps.first[j]; tap < columnTaps.first[j + 1]; tap++) {
 
-    float center = ((float)k + 0.5f) / a - 0.5f;
-    float radius = (a < 1.0f) ? (1.0f / a) : 1.0f;
+                const float* row = sourceRow(columnTaps.sources[tap]);
+                float weight = columnTaps.weights[tap];
 
-    int left = (int)std::floor(center - radius);
-    int right = (int)std::ceil(center + radius);
+                int x = 0;
+                for (; x + RAY_PACKET_WIDTH <= 4 * width; x += RAY_PACKET_WIDTH) {
+                    PacketFloat sum = PacketFloat::load(out + x) + PacketFloat(weight) * PacketFloat::load(row + x);
+                    sum.store(out + x);
+                }
+                for (; x < 4 * width; x++) out[x] += weight * row[x];
 
-    left = std::max(left, 0 - 1);
-    right = std::min(right, (horizontal ? fWidth : fHeight) - 1 + 1);
+            }
 
-    for (int s = left; s <= right; ++s) {
+            // Horizontal Pass --
+            for (int i = 0; i < targetWidth; i++) {
 
-        int sourceIndex;
+                float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                for (int tap = rowTaps.first[i]; tap < rowTaps.first[i + 1]; tap++) {
 
-        if (horizontal) {
+                    const float* texel = out + 4 * rowTaps.sources[tap];
+                    for (int channel = 0; channel < 4; channel++) sum[channel] += rowTaps.weights[tap] * texel[channel];
 
-            int sx = ((s % fWidth) + fWidth) % fWidth;
-            sourceIndex = ((row % fHeight) * fWidth) + sx;
+                }
 
-        } else {
+                for (int channel = 0; channel < 4; channel++) result[4 * (targetWidth * j + i) + channel] = sum[channel];
 
-            int sy = ((s % fHeight) + fHeight) % fHeight;
-            sourceIndex = (sy * fWidth) + (col % fWidth);
+            }
 
         }
 
-        float w = filter((float)(s - center), radius);
-        sum += w * toFloat(f[sourceIndex]);
-        weights_sum += w;
-    }
+    });
+
+    return result;
+
+}
 
-    if (weights_sum <= 0.0f) return glm::vec4(0.0f);
-    return sum / weights_sum;
+// Takes vec4 color values and returns the blended version.
+glm::vec4 lerp(glm::vec4 a, glm::vec4 b, float weight) {
+
+    return (1 - weight) * a + weight * b;
 
 }
 
-glm::vec4 Texture::sampleNearest(glm::vec2 uv) {
+glm::vec4 Texture::sampleNearest(glm::vec2 uv) const {
 
     int x, y;
 
@@ -204,19 +339,19 @@ glm::vec4 Texture::sampleNearest(glm::vec2 uv) {
     x = glm::clamp(x, 0, texture->width - 1);
     y = glm::clamp(y, 0, texture->height - 1);
 
-    RGBA textureColor = texture->data[pointToIndex(x, y, texture->width)];
+    RGBA textureColor = texture->data[texelIndex(x, y, texture->width)];
     glm::vec4 textureColorNorm = glm::vec4((float)textureColor.r, (float)textureColor.g, (float)textureColor.b, 255.0f) / 255.0f;
 
     return textureColorNorm;
 
 }
 
-glm::vec4 Texture::sampleBilinear(glm::vec2& uv, float level, bool mipmap) {
+glm::vec4 Texture::sampleBilinear(glm::vec2& uv, float level, bool mipmap) const {
 
     int b_level;
     b_level = (mipmap) ? (int)glm::clamp(glm::ceil(level), 0.0f, m_levels.size() - 1.0f) : 0;
 
-    Image* map = m_levels[b_level];
+    const Image* map = m_levels[b_level].get();
 
     float x_left, x_right, y_top, y_bottom;
 
@@ -253,10 +388,10 @@ glm::vec4 Texture::sampleBilinear(glm::vec2& uv, float level, bool mipmap) {
     glm::vec4 c00, c01, c10, c11;
     glm::vec4 I_top, I_bottom, I_final;
 
-    c00 = toFloat(map->data[pointToIndex(c_left, r_top, map->width)]);
-    c01 = toFloat(map->data[pointToIndex(c_right, r_top, map->width)]);
-    c10 = toFloat(map->data[pointToIndex(c_left, r_bottom, map->width)]);
-    c11 = toFloat(map->data[pointToIndex(c_right, r_bottom, map->width)]);
+    c00 = toFloat(map->data[texelIndex(c_left, r_top, map->width)]);
+    c01 = toFloat(map->data[texelIndex(c_right, r_top, map->width)]);
+    c10 = toFloat(map->data[texelIndex(c_left, r_bottom, map->width)]);
+    c11 = toFloat(map->data[texelIndex(c_right, r_bottom, map->width)]);
 
     I_top = lerp(c00, c01, a_x);
     I_bottom = lerp(c10, c11, a_x);
@@ -267,7 +402,7 @@ glm::vec4 Texture::sampleBilinear(glm::vec2& uv, float level, bool mipmap) {
 
 }
 
-glm::vec4 Texture::sampleTrilinear(glm::vec2& uv, float& fractionalLevel, bool mipmap) {
+glm::vec4 Texture::sampleTrilinear(glm::vec2& uv, float& fractionalLevel, bool mipmap) const {
 
     int levelA, levelB;
     levelA = floor(fractionalLevel);
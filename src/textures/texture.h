@@ -1,31 +1,72 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <memory>
 #include "utils/imagereader.h"
 #include "utils/sceneparser.h"
 
+class QFile;
+
+#define TEXTURE_TILE_SIZE 64
+#define TEXTURE_PARALLEL_PIXELS (512 * 512) // Smaller mip levels are filtered on the calling thread
+
+// Texels of every level are stored in square blocks, so a bilinear footprint (and the neighbouring footprints of
+// nearby rays) mostly falls within one or two cache lines. Define TEXTURE_DISABLE_BLOCKS for plain row-major storage.
+#if defined(TEXTURE_DISABLE_BLOCKS)
+#define TEXTURE_BLOCK_SIZE 1
+#else
+#define TEXTURE_BLOCK_SIZE 8
+#endif
+
+// An image and its mip chain, sampled with the texture settings (repeat) of a material.
+// Textures are immutable once built, so shapes that use the same file and settings share one through load().
+
 class Texture {
 
 public:
 
-    Image* texture;
+    const Image* texture; // Level 0, owned by m_levels
     SceneFileMap info;
-    std::vector<Image*> m_levels;
-    float blend;
+    std::vector<ImagePtr> m_levels; // Texel data in TEXTURE_BLOCK_SIZE blocks, not row-major
+
+    // Takes ownership of image (row-major, as loaded), which becomes level 0.
+    Texture(ImagePtr image, SceneFileMap info);
 
-    Texture();
-    Texture(Image* texture, SceneFileMap info, float blend);
+    // Returns the texture for map, loading its file and building the mip chain on first use.
+    // Returns nullptr if the image cannot be loaded.
+    // Uses the on-disk TextureCache when it is enabled.
+    // threadCount bounds the threads that filter the mip chain; 0 uses every hardware thread.
+    static std::shared_ptr<const Texture> load(const SceneFileMap& map, int threadCount = 0);
 
-    void generateMaps();
-    glm::vec4 sampleNearest(glm::vec2 uv);
-    glm::vec4 sampleBilinear(glm::vec2& uv, float level, bool mipmap);
-    glm::vec4 sampleTrilinear(glm::vec2& uv, float& fractionalLevel, bool mipmap);
+    ~Texture();
 
-    void debug(const std::string& baseFilename);
+    // Number of texels allocated for a width x height level; whole blocks, so at least width * height.
+    static int storageSize(int width, int height);
+
+    // Builds the mip chain below level 0 on up to threadCount threads (0 for every hardware thread).
+    void generateMaps(int threadCount = 0);
+    glm::vec4 sampleNearest(glm::vec2 uv) const;
+    glm::vec4 sampleBilinear(glm::vec2& uv, float level, bool mipmap) const;
+    glm::vec4 sampleTrilinear(glm::vec2& uv, float& fractionalLevel, bool mipmap) const;
 
 
 private:
 
-    Image* downsample(float& scaleX, float& scaleY, int& width, int& height);
-    glm::vec4 tent(int& k, float& a, std::vector<RGBA>& f, int& row, int& col, int fWidth, int fHeight, bool horizontal = true);
+    std::unique_ptr<QFile> m_mapping; // Backs m_levels when they were mapped from the cache
+
+    // Takes levels mapped from a cache file, with the file they point into.
+    Texture(std::vector<ImagePtr> levels, std::unique_ptr<QFile> mapping, SceneFileMap info);
+
+    // Source texels and normalized weights of every output texel along one axis:
+    // output k uses sources/weights in [first[k], first[k + 1]).
+    struct FilterTaps {
+        std::vector<int> first;
+        std::vector<int> sources;
+        std::vector<float> weights;
+    };
+
+    static ImagePtr toBlocks(ImagePtr image);
+    static FilterTaps filterTaps(int sourceSize, int targetSize);
+    static std::vector<float> downsample(const Image* image, const std::vector<float>& source, int width, int height,
+                                         int targetWidth, int targetHeight, int threadCount);
 
 };
@@ -0,0 +1,190 @@
+#include "texturecache.h"
+#include "texture.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const char cacheMagic[8] = {'R', 'T', 'M', 'I', 'P', 'S', '\0', '\0'};
+
+// Layout of a cache file: the header, levelCount CacheLevels, then the texels of each level at its offset.
+struct CacheHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t blockSize;        // TEXTURE_BLOCK_SIZE the levels were written with
+    std::uint32_t levelCount;
+    std::uint32_t reserved;
+    std::int64_t sourceSize;        // Bytes
+    std::int64_t sourceModified;    // Milliseconds since the epoch
+};
+
+struct CacheLevel {
+    std::int32_t width;
+    std::int32_t height;
+    std::uint64_t offset;
+};
+
+std::string cacheDirectory;
+
+// FNV-1a, so the cache name of a file is the same from run to run.
+std::uint64_t hashPath(const std::string& path) {
+
+    std::uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : path) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+
+}
+
+// Cache file of source, named after it plus a hash of its absolute path so equal names in different folders differ.
+QString cachePath(const QFileInfo& source) {
+
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)hashPath(source.absoluteFilePath().toStdString()));
+
+    return QDir(QString::fromStdString(cacheDirectory)).filePath(
+        QString::fromStdString(source.completeBaseName().toStdString() + "-" + hash + ".mips"));
+
+}
+
+std::uint64_t levelBytes(int width, int height) {
+
+    return (std::uint64_t)Texture::storageSize(width, height) * sizeof(RGBA);
+
+}
+
+std::uint64_t align(std::uint64_t offset) {
+
+    return (offset + TEXTURE_CACHE_ALIGNMENT - 1) / TEXTURE_CACHE_ALIGNMENT * TEXTURE_CACHE_ALIGNMENT;
+
+}
+
+} // namespace
+
+void TextureCache::setDirectory(const std::string& directory) {
+
+    cacheDirectory = directory;
+
+    if (!cacheDirectory.empty() && !QDir().mkpath(QString::fromStdString(cacheDirectory))) {
+        std::cout << "Failed to create texture cache directory: " << cacheDirectory << std::endl;
+        cacheDirectory.clear();
+    }
+
+}
+
+std::unique_ptr<QFile> TextureCache::map(const std::string& source, std::vector<ImagePtr>& levels) {
+
+    if (cacheDirectory.empty()) return nullptr;
+
+    QFileInfo sourceInfo(QString::fromStdString(source));
+    if (!sourceInfo.exists()) return nullptr;
+
+    std::unique_ptr<QFile> file = std::make_unique<QFile>(cachePath(sourceInfo));
+    if (!file->open(QIODevice::ReadOnly)) return nullptr;
+
+    std::uint64_t size = file->size();
+    if (size < sizeof(CacheHeader)) return nullptr;
+
+    const uchar* data = file->map(0, size);
+    if (!data) return nullptr;
+
+    // Validation --
+    // Anything that does not match the source as it is now, or this build's layout, is a miss.
+    CacheHeader header;
+    std::memcpy(&header, data, sizeof(header));
+
+    if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+        header.version != TEXTURE_CACHE_VERSION ||
+        header.blockSize != TEXTURE_BLOCK_SIZE ||
+        header.sourceSize != sourceInfo.size() ||
+        header.sourceModified != sourceInfo.lastModified().toMSecsSinceEpoch() ||
+        header.levelCount == 0 ||
+        size < sizeof(CacheHeader) + (std::uint64_t)header.levelCount * sizeof(CacheLevel)) {
+        return nullptr;
+    }
+
+    std::vector<ImagePtr> mapped;
+
+    for (std::uint32_t index = 0; index < header.levelCount; index++) {
+
+        CacheLevel level;
+        std::memcpy(&level, data + sizeof(CacheHeader) + index * sizeof(CacheLevel), sizeof(level));
+
+        if (level.width <= 0 || level.height <= 0 || level.offset % TEXTURE_CACHE_ALIGNMENT != 0 ||
+            level.offset > size || levelBytes(level.width, level.height) > size - level.offset) {
+            return nullptr;
+        }
+
+        RGBA* texels = reinterpret_cast<RGBA*>(const_cast<uchar*>(data) + level.offset);
+        mapped.push_back(ImagePtr(new Image{texels, level.width, level.height}, ImageDeleter{false}));
+
+    }
+
+    levels = std::move(mapped);
+    return file;
+
+}
+
+void TextureCache::store(const std::string& source, const std::vector<ImagePtr>& levels) {
+
+    if (cacheDirectory.empty() || levels.empty()) return;
+
+    QFileInfo sourceInfo(QString::fromStdString(source));
+    if (!sourceInfo.exists()) return;
+
+    CacheHeader header{};
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = TEXTURE_CACHE_VERSION;
+    header.blockSize = TEXTURE_BLOCK_SIZE;
+    header.levelCount = (std::uint32_t)levels.size();
+    header.sourceSize = sourceInfo.size();
+    header.sourceModified = sourceInfo.lastModified().toMSecsSinceEpoch();
+
+    std::vector<CacheLevel> table;
+    std::uint64_t offset = align(sizeof(CacheHeader) + levels.size() * sizeof(CacheLevel));
+
+    for (const ImagePtr& level : levels) {
+        table.push_back(CacheLevel{level->width, level->height, offset});
+        offset = align(offset + levelBytes(level->width, level->height));
+    }
+
+    // Written to a temporary file and renamed into place, so a concurrent run never maps a partial cache.
+    QSaveFile file(cachePath(sourceInfo));
+    if (!file.open(QIODevice::WriteOnly)) {
+        std::cout << "Failed to write texture cache for: " << source << std::endl;
+        return;
+    }
+
+    bool ok = true;
+    std::uint64_t written = 0;
+    auto write = [&](const void* bytes, std::uint64_t count) {
+        ok = ok && file.write(static_cast<const char*>(bytes), count) == (qint64)count;
+        written += count;
+    };
+
+    write(&header, sizeof(header));
+    write(table.data(), table.size() * sizeof(CacheLevel));
+
+    for (std::size_t index = 0; index < levels.size(); index++) {
+
+        std::vector<char> padding(table[index].offset - written, 0);
+        write(padding.data(), padding.size());
+        write(levels[index]->data, levelBytes(levels[index]->width, levels[index]->height));
+
+    }
+
+    // Without a commit the temporary file is thrown away.
+    if (!ok || !file.commit()) {
+        std::cout << "Failed to write texture cache for: " << source << std::endl;
+    }
+
+}
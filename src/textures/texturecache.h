@@ -0,0 +1,25 @@
+#pragma once
+
+#include <QFile>
+#include <memory>
+#include <string>
+#include <vector>
+#include "utils/imagereader.h"
+
+#define TEXTURE_CACHE_VERSION 1
+#define TEXTURE_CACHE_ALIGNMENT 64 // Every level starts on a cache line
+
+// Built textures saved on disk: every mip level of an image, already in the sampler's block layout, so later runs
+// map the file instead of decoding the image and filtering its levels again. A cache file is only used while its
+// source image keeps the size and modification time it had when the cache was written.
+namespace TextureCache {
+    // Sets the directory cache files are kept in, creating it if needed. Caching is off while it is empty.
+    void setDirectory(const std::string& directory);
+
+    // Maps the cached levels of source into levels, which point into the returned file and stay valid while it is open.
+    // Returns nullptr (and leaves levels alone) if caching is off or there is no valid cache for source.
+    std::unique_ptr<QFile> map(const std::string& source, std::vector<ImagePtr>& levels);
+
+    // Writes the levels built from source to the cache, replacing any earlier cache of it.
+    void store(const std::string& source, const std::vector<ImagePtr>& levels);
+} // namespace TextureCache
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cfloat>
+
+// An axis-aligned bounding box. A default constructed box is empty and grows with expand().
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    void expand(const glm::vec3 &point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void expand(const AABB &box) {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    bool isEmpty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    glm::vec3 centroid() const {
+        return 0.5f * (min + max);
+    }
+
+    float surfaceArea() const {
+        if (isEmpty()) return 0.0f;
+        glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    int largestAxis() const {
+        glm::vec3 d = max - min;
+        if (d.x > d.y && d.x > d.z) return 0;
+        return (d.y > d.z) ? 1 : 2;
+    }
+
+    // Returns the box enclosing this box after transforming it by m.
+    AABB transformed(const glm::mat4 &m) const {
+        AABB box;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 p((corner & 1) ? max.x : min.x,
+                        (corner & 2) ? max.y : min.y,
+                        (corner & 4) ? max.z : min.z);
+            box.expand(glm::vec3(m * glm::vec4(p, 1.0f)));
+        }
+        return box;
+    }
+
+    // Slab test against a ray given by its origin and reciprocal direction.
+    // On a hit, tNear is the parametric distance at which the ray enters the box (clamped to 0).
+    bool intersect(const glm::vec3 &origin, const glm::vec3 &invDirection, float tMax, float &tNear) const {
+        glm::vec3 t0 = (min - origin) * invDirection;
+        glm::vec3 t1 = (max - origin) * invDirection;
+
+        glm::vec3 tSmall = glm::min(t0, t1);
+        glm::vec3 tLarge = glm::max(t0, t1);
+
+        float enter = glm::max(glm::max(tSmall.x, tSmall.y), glm::max(tSmall.z, 0.0f));
+        float exit = glm::min(glm::min(tLarge.x, tLarge.y), glm::min(tLarge.z, tMax));
+
+        tNear = enter;
+        return enter <= exit;
+    }
+};
@@ -0,0 +1,85 @@
+#include "animation.h"
+#include <glm/gtx/transform.hpp>
+#include <algorithm>
+
+namespace {
+
+// Finds the keys around frame: keys[first] and keys[first + 1] are blended by the returned weight.
+// Frames outside the keys hold the nearest one (weight 0, and first + 1 clamped to the last key).
+template <typename Key>
+float bracket(const std::vector<Key> &keys, float frame, int &first, int &second) {
+
+    int last = (int)keys.size() - 1;
+
+    first = 0;
+    while (first < last && keys[first + 1].frame <= frame) first++;
+    second = std::min(first + 1, last);
+
+    float span = keys[second].frame - keys[first].frame;
+    if (span <= 0.0f) return 0.0f;
+
+    return glm::clamp((frame - keys[first].frame) / span, 0.0f, 1.0f);
+
+}
+
+} // namespace
+
+glm::mat4 AnimationPath::ctm(const SceneAnimation &animation, float frame) const {
+
+    glm::mat4 ctm = base;
+    for (const Segment &segment : segments) {
+        ctm = ctm * Animation::transform(animation.tracks[segment.track], frame) * segment.after;
+    }
+
+    return ctm;
+
+}
+
+int Animation::findTrack(const SceneAnimation &animation, const std::string &group) {
+
+    for (int track = 0; track < (int)animation.tracks.size(); track++) {
+        if (animation.tracks[track].group == group) return track;
+    }
+
+    return -1;
+
+}
+
+glm::mat4 Animation::transform(const SceneAnimationTrack &track, float frame) {
+
+    int first, second;
+    float weight = bracket(track.keys, frame, first, second);
+
+    const SceneKeyframe &a = track.keys[first];
+    const SceneKeyframe &b = track.keys[second];
+
+    // Angles are blended rather than rotations, so keys a full turn apart spin the group instead of holding it still.
+    glm::vec3 translate = glm::mix(a.translate, b.translate, weight);
+    glm::vec3 axis = glm::mix(a.rotate, b.rotate, weight);
+    float angle = glm::mix(a.angle, b.angle, weight);
+    glm::vec3 scale = glm::mix(a.scale, b.scale, weight);
+
+    glm::mat4 rotation = (glm::dot(axis, axis) > 0.0f) ? glm::rotate(angle, glm::normalize(axis)) : glm::mat4(1.0f);
+
+    return glm::translate(translate) * rotation * glm::scale(scale);
+
+}
+
+SceneCameraData Animation::camera(const SceneAnimation &animation, const SceneCameraData &camera, float frame) {
+
+    if (animation.camera.empty()) return camera;
+
+    int first, second;
+    float weight = bracket(animation.camera, frame, first, second);
+
+    const SceneCameraKeyframe &a = animation.camera[first];
+    const SceneCameraKeyframe &b = animation.camera[second];
+
+    SceneCameraData result = camera;
+    result.pos = glm::mix(a.pos, b.pos, weight);
+    result.look = glm::mix(a.look, b.look, weight);
+    result.up = glm::mix(a.up, b.up, weight);
+
+    return result;
+
+}
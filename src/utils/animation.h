@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "scenedata.h"
+
+// The transforms from the root of the scene graph down to one primitive or light, split at every animated group:
+// ctm = base * track(segments[0]) * segments[0].after * track(segments[1]) * segments[1].after * ...
+// Objects without an animated group above them have no segments, and their CTM never changes.
+struct AnimationPath {
+    struct Segment {
+        int track;       // Index into SceneAnimation::tracks
+        glm::mat4 after; // Static transforms from inside the animated group down to the next one (or the object)
+    };
+
+    glm::mat4 base = glm::mat4(1.0f);
+    std::vector<Segment> segments;
+
+    bool isAnimated() const { return !segments.empty(); }
+
+    // The CTM of the object at frame.
+    glm::mat4 ctm(const SceneAnimation &animation, float frame) const;
+};
+
+namespace Animation {
+    // Returns the index of the track animating groups named group, or -1.
+    int findTrack(const SceneAnimation &animation, const std::string &group);
+
+    // The keyed transform of a track at frame.
+    glm::mat4 transform(const SceneAnimationTrack &track, float frame);
+
+    // The camera at frame: camera with the keyed position, look and up, or camera itself if nothing is keyed.
+    SceneCameraData camera(const SceneAnimation &animation, const SceneCameraData &camera, float frame);
+} // namespace Animation
@@ -0,0 +1,314 @@
+#include "batchrenderer.h"
+#include "configreader.h"
+#include "imagewriter.h"
+#include "sceneparser.h"
+#include "raytracer/raytracer.h"
+#include "raytracer/raytracescene.h"
+#include "raytracer/tilescheduler.h"
+#include "textures/texturecache.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QSettings>
+#include <QTextStream>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+namespace {
+
+// Scenes are shared by scene file and canvas size; the camera depends on the aspect ratio.
+using SceneKey = std::tuple<std::string, int, int>;
+
+struct Job {
+    std::string config;
+    SceneKey scene;
+};
+
+// A scene loaded by the first job that needs it and dropped after the last one.
+// Posing a scene changes it, so an animated scene is only parsed here; each of its jobs builds a scene of its own.
+struct SceneEntry {
+    std::mutex mutex; // Held while loading, so jobs waiting on the scene do not load it again
+    std::shared_ptr<const RayTraceScene> scene;   // A still scene, rendered as is by every job
+    std::shared_ptr<const RenderData> animation;  // An animated scene, parsed
+    std::vector<std::shared_ptr<Shape>> shapes;   // Shapes of the first job's copy of an animated scene, which keep
+                                                  // its meshes and textures loaded until the last job
+    bool failed = false;
+    int remainingJobs = 0;
+};
+
+void addConfig(const QString& path, std::vector<std::string>& configs) {
+
+    QFileInfo info(path);
+
+    if (!path.contains('*') && !path.contains('?') && !path.contains('[')) {
+        configs.push_back(path.toStdString());
+        return;
+    }
+
+    QDir directory(info.path());
+    for (const QString& name : directory.entryList(QStringList{info.fileName()}, QDir::Files, QDir::Name)) {
+        configs.push_back(directory.filePath(name).toStdString());
+    }
+
+}
+
+} // namespace
+
+std::vector<std::string> BatchRenderer::collectConfigs(const QStringList& arguments, const QString& manifest) {
+
+    std::vector<std::string> configs;
+
+    for (const QString& argument : arguments) addConfig(argument, configs);
+
+    if (!manifest.isEmpty()) {
+
+        QFile file(manifest);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            std::cerr << "Error: failed to open manifest \"" << manifest.toStdString() << "\"" << std::endl;
+            return configs;
+        }
+
+        QTextStream stream(&file);
+        while (!stream.atEnd()) {
+
+            QString line = stream.readLine().trimmed();
+            if (line.isEmpty() || line.startsWith('#')) continue;
+
+            addConfig(line, configs);
+
+        }
+
+    }
+
+    return configs;
+
+}
+
+int BatchRenderer::run(const std::vector<std::string>& configs, int threadCount, int jobCount) {
+
+    if (configs.empty()) return 0;
+
+    if (threadCount <= 0) threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+    if (jobCount <= 0) jobCount = threadCount;
+    jobCount = std::clamp(jobCount, 1, (int)configs.size());
+
+    int threadsPerJob = std::max(1, threadCount / jobCount);
+
+    // Jobs --
+    // Every config is read up front to count the jobs of each scene. Jobs of one scene are kept next to each other,
+    // so a worker tends to render them back to back while the scene is loaded.
+    std::vector<Job> jobs;
+    std::map<SceneKey, SceneEntry> scenes;
+
+    for (const std::string& config : configs) {
+
+        QSettings settings(QString::fromStdString(config), QSettings::IniFormat);
+        SceneKey key(settings.value("IO/scene").toString().toStdString(),
+                     settings.value("Canvas/width").toInt(),
+                     settings.value("Canvas/height").toInt());
+
+        jobs.push_back(Job{config, key});
+        scenes[key].remainingJobs++;
+
+    }
+
+    std::stable_sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) { return a.scene < b.scene; });
+
+    // The texture cache is process wide, so the first config's setting applies to the whole batch.
+    QSettings firstSettings(QString::fromStdString(configs.front()), QSettings::IniFormat);
+    TextureCache::setDirectory(firstSettings.value("IO/texture-cache").toString().toStdString());
+
+    // Textures of every scene built so far. Scenes are dropped after their last job, but other scenes of the batch
+    // often use the same images, so the textures are kept until the batch ends.
+    std::mutex texturesMutex;
+    std::vector<std::shared_ptr<const Texture>> textures;
+
+    std::mutex outputMutex;
+    int failures = 0;
+    int finished = 0;
+
+    auto keepTextures = [&](const std::vector<std::shared_ptr<Shape>>& shapes) {
+
+        std::lock_guard<std::mutex> texturesLock(texturesMutex);
+        for (const std::shared_ptr<Shape>& shape : shapes) {
+            if (shape->texture) textures.push_back(shape->texture);
+        }
+
+    };
+
+    // Loads the scene of key on first use. Returns the shared scene of a still scene in scene, or the parsed data
+    // of an animated one in animation; both are null if the scene failed to load.
+    auto acquireScene = [&](const SceneKey& key, std::shared_ptr<const RayTraceScene>& scene,
+                            std::shared_ptr<const RenderData>& animation) {
+
+        SceneEntry& entry = scenes.at(key);
+        std::lock_guard<std::mutex> lock(entry.mutex);
+
+        if (!entry.scene && !entry.animation && !entry.failed) {
+
+            auto metaData = std::make_shared<RenderData>();
+            if (!SceneParser::parse(std::get<0>(key), *metaData)) {
+                entry.failed = true;
+            } else if (metaData->animation.frameCount > 1) {
+                entry.animation = metaData;
+            } else {
+                entry.scene = std::make_shared<const RayTraceScene>(std::get<1>(key), std::get<2>(key), *metaData,
+                                                                    threadsPerJob);
+                keepTextures(entry.scene->getShapeData());
+            }
+
+        }
+
+        scene = entry.scene;
+        animation = entry.animation;
+
+    };
+
+    // Called by each job of an animated scene with the shapes of the scene it built.
+    auto keepShapes = [&](const SceneKey& key, const std::vector<std::shared_ptr<Shape>>& shapes) {
+
+        SceneEntry& entry = scenes.at(key);
+        std::lock_guard<std::mutex> lock(entry.mutex);
+
+        if (entry.shapes.empty()) {
+            entry.shapes = shapes;
+            keepTextures(shapes);
+        }
+
+    };
+
+    auto releaseScene = [&](const SceneKey& key) {
+
+        SceneEntry& entry = scenes.at(key);
+        std::lock_guard<std::mutex> lock(entry.mutex);
+
+        if (--entry.remainingJobs == 0) {
+            entry.scene.reset();
+            entry.animation.reset();
+            entry.shapes.clear();
+        }
+
+    };
+
+    // Renders one config, returning an error message or an empty string on success.
+    auto render = [&](const Job& job) -> std::string {
+
+        QSettings settings(QString::fromStdString(job.config), QSettings::IniFormat);
+        QString oImagePath = settings.value("IO/output").toString();
+
+        RayTracer::Config rtConfig = ConfigReader::rayTracerConfig(settings);
+        rtConfig.threadCount = threadsPerJob;
+
+        if (rtConfig.textureFilterType == TextureFilterType::Trilinear && !rtConfig.enableMipMapping) {
+            return "Trilinear filtering requires mip-mapping.";
+        }
+
+        std::shared_ptr<const RayTraceScene> scene;
+        std::shared_ptr<const RenderData> animation;
+        acquireScene(job.scene, scene, animation);
+        if (!scene && !animation) return "Error loading scene: \"" + std::get<0>(job.scene) + "\"";
+
+        int width = std::get<1>(job.scene);
+        int height = std::get<2>(job.scene);
+
+        bool hdr = ImageWriter::isHDR(oImagePath);
+        std::vector<glm::vec4> hdrData(hdr ? width * height : 0);
+
+        QImage image = hdr ? QImage() : QImage(width, height, QImage::Format_RGBX8888);
+        image.fill(Qt::black);
+        RGBA *data = reinterpret_cast<RGBA *>(image.bits());
+
+        RayTracer raytracer{ rtConfig };
+        bool saved = true;
+
+        auto renderImage = [&](const RayTraceScene& toRender) {
+            if (hdr) raytracer.render(hdrData.data(), toRender);
+            else raytracer.render(data, toRender);
+        };
+
+        auto saveImage = [&](const QString& path) {
+            if (hdr) saved = ImageWriter::write(path, hdrData.data(), width, height);
+            else saved = image.save(path) || image.save(path, "PNG");
+        };
+
+        if (animation) {
+
+            // The scene is parsed once for all its jobs. Its meshes and textures come from their caches after the
+            // first job, so building this copy mostly costs the scene's own BVH, which posing refits anyway.
+            RayTraceScene animated(width, height, *animation, threadsPerJob);
+            keepShapes(job.scene, animated.getShapeData());
+
+            int firstFrame, lastFrame;
+            ConfigReader::frameRange(settings, animated.frameCount(), firstFrame, lastFrame);
+
+            for (int frame = firstFrame; frame <= lastFrame && saved; frame++) {
+                animated.setFrame(frame);
+                renderImage(animated);
+                saveImage(ConfigReader::framePath(oImagePath, frame));
+            }
+
+        } else if (rtConfig.enableProgressive) {
+            if (hdr) raytracer.renderProgressive(hdrData.data(), *scene, [&](int) { saveImage(oImagePath); });
+            else raytracer.renderProgressive(data, *scene, [&](int) { saveImage(oImagePath); });
+        } else {
+            renderImage(*scene);
+            saveImage(oImagePath);
+        }
+
+        if (!saved) return "Failed to save image to \"" + oImagePath.toStdString() + "\"";
+
+        return std::string();
+
+    };
+
+    auto batchStart = std::chrono::steady_clock::now();
+
+    // One job per tile of a jobs x 1 "image": the scheduler hands them out to jobCount workers and balances the load.
+    TileScheduler((int)jobs.size(), 1, 1, jobCount).run([&](const Tile &tile) {
+
+        const Job& job = jobs[tile.x0];
+
+        auto start = std::chrono::steady_clock::now();
+
+        // An exception must not leave the scheduler's thread, which would end the whole batch; e.g. ConfigReader
+        // throws on an unknown super-sampler-pattern or tone-map.
+        std::string error;
+        try {
+            error = render(job);
+        } catch (const std::exception &exception) {
+            error = exception.what();
+        }
+
+        auto end = std::chrono::steady_clock::now();
+
+        releaseScene(job.scene);
+
+        std::lock_guard<std::mutex> lock(outputMutex);
+        finished++;
+
+        if (error.empty()) {
+            std::cout << "[" << finished << "/" << jobs.size() << "] Rendered \"" << job.config << "\" in "
+                      << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+        } else {
+            failures++;
+            std::cerr << "[" << finished << "/" << jobs.size() << "] Error in \"" << job.config << "\": " << error << std::endl;
+        }
+
+    });
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+    std::cout << "Rendered " << (jobs.size() - failures) << " of " << jobs.size() << " configs in " << seconds
+              << " s (" << jobCount << " at a time, " << threadsPerJob << " render threads per job)" << std::endl;
+
+    return failures;
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <string>
+#include <vector>
+
+// Renders many config files in one process, instead of one process per config.
+// Jobs naming the same scene file and canvas size share one parsed and built scene, textures stay loaded
+// for the whole batch, and several jobs run at once within a single thread budget.
+namespace BatchRenderer {
+    // Expands config arguments into .ini paths. An argument is either a file or a wildcard pattern
+    // (e.g. "template_inis/illuminate/*.ini"). A manifest, if given, lists one config per line; blank lines
+    // and lines starting with # are skipped. Relative paths are taken from the working directory, like the
+    // scene and output paths inside the configs.
+    std::vector<std::string> collectConfigs(const QStringList& arguments, const QString& manifest);
+
+    // Renders every config. threadCount bounds the render threads of all jobs together, 0 for the hardware
+    // concurrency; jobCount is how many configs render at once, 0 for one per thread (at most one per config).
+    // Each job gets an equal share of the threads when its config enables parallelism.
+    // @return The number of configs that failed to render.
+    int run(const std::vector<std::string>& configs, int threadCount, int jobCount);
+} // namespace BatchRenderer
@@ -0,0 +1,80 @@
+#include "configreader.h"
+#include "ini_utils.h"
+#include <algorithm>
+
+RayTracer::Config ConfigReader::rayTracerConfig(const QSettings& settings) {
+
+    RayTracer::Config rtConfig{};
+    rtConfig.enableShadow        = settings.value("Feature/shadows").toBool();
+    rtConfig.enableReflection    = settings.value("Feature/reflect").toBool();
+    rtConfig.enableRefraction    = settings.value("Feature/refract").toBool();
+
+    rtConfig.enableTextureMap = settings.value("Feature/texture").toBool();
+
+    if (rtConfig.enableTextureMap)
+        rtConfig.textureFilterType = IniUtils::textureFilterTypeFromString(settings.value("Feature/texture-filter").toString());
+
+    rtConfig.enableParallelism   = settings.value("Feature/parallel").toBool();
+    if (settings.contains("Settings/thread-count"))
+        rtConfig.threadCount = settings.value("Settings/thread-count").toInt();
+
+    rtConfig.enableSuperSample   = settings.value("Feature/super-sample").toBool();
+    if (settings.contains("Settings/samples-per-pixel"))
+        rtConfig.samplesPerPixel = settings.value("Settings/samples-per-pixel").toInt();
+    if (settings.contains("Settings/super-sampler-pattern"))
+        rtConfig.superSamplerPattern = IniUtils::superSamplerPatternFromString(settings.value("Settings/super-sampler-pattern").toString());
+    if (settings.contains("Settings/adaptive-threshold"))
+        rtConfig.adaptiveThreshold = settings.value("Settings/adaptive-threshold").toFloat();
+    if (settings.contains("Settings/seed"))
+        rtConfig.seed = settings.value("Settings/seed").toUInt();
+
+    rtConfig.enableAcceleration  = settings.value("Feature/acceleration").toBool();
+    if (settings.contains("Feature/packets"))
+        rtConfig.enablePacketTracing = settings.value("Feature/packets").toBool();
+    if (settings.contains("Feature/wavefront"))
+        rtConfig.enableWavefront = settings.value("Feature/wavefront").toBool();
+    if (settings.contains("Feature/ray-binning"))
+        rtConfig.enableRayBinning = settings.value("Feature/ray-binning").toBool();
+    rtConfig.enableDepthOfField  = settings.value("Feature/depthoffield").toBool();
+    rtConfig.enableProgressive   = settings.value("Feature/progressive").toBool();
+    if (settings.contains("Settings/time-budget-ms"))
+        rtConfig.timeBudgetMs = settings.value("Settings/time-budget-ms").toInt();
+    rtConfig.maxRecursiveDepth   = settings.value("Settings/maximum-recursive-depth").toInt();
+    if (settings.contains("Settings/min-throughput"))
+        rtConfig.minThroughput = settings.value("Settings/min-throughput").toFloat();
+    if (settings.contains("Feature/russian-roulette"))
+        rtConfig.enableRussianRoulette = settings.value("Feature/russian-roulette").toBool();
+    if (settings.contains("Settings/roulette-threshold"))
+        rtConfig.rouletteThreshold = settings.value("Settings/roulette-threshold").toFloat();
+    rtConfig.onlyRenderNormals   = settings.value("Settings/only-render-normals").toBool();
+    if (settings.contains("Settings/tone-map"))
+        rtConfig.toneMap = IniUtils::toneMapOperatorFromString(settings.value("Settings/tone-map").toString());
+    if (settings.contains("Settings/exposure"))
+        rtConfig.exposure = settings.value("Settings/exposure").toFloat();
+
+    rtConfig.enableMipMapping = settings.value("Feature/mipmapping").toBool();
+
+    return rtConfig;
+
+}
+
+void ConfigReader::frameRange(const QSettings& settings, int frameCount, int& first, int& last) {
+
+    first = 0;
+    last = frameCount - 1;
+
+    if (settings.contains("Animation/first-frame"))
+        first = std::clamp(settings.value("Animation/first-frame").toInt(), 0, frameCount - 1);
+    if (settings.contains("Animation/last-frame"))
+        last = std::clamp(settings.value("Animation/last-frame").toInt(), first, frameCount - 1);
+
+}
+
+QString ConfigReader::framePath(const QString& output, int frame) {
+
+    int extension = output.lastIndexOf('.');
+    if (extension <= output.lastIndexOf('/')) extension = output.size();
+
+    return output.left(extension) + QString("_%1").arg(frame, 4, 10, QChar('0')) + output.mid(extension);
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <QSettings>
+#include "raytracer/raytracer.h"
+
+namespace ConfigReader {
+    // Reads the [Feature] and [Settings] sections of a config file into a ray tracer configuration.
+    // Optional settings that are missing keep their Config defaults.
+    RayTracer::Config rayTracerConfig(const QSettings& settings);
+
+    // The frames [first, last] of an animation of frameCount frames that a config asks for:
+    // Animation/first-frame to Animation/last-frame where given, every frame otherwise.
+    void frameRange(const QSettings& settings, int frameCount, int& first, int& last);
+
+    // Output path of one frame of an animation, with the frame number before the extension (out_0007.png).
+    QString framePath(const QString& output, int frame);
+} // namespace ConfigReader
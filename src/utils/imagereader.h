@@ -4,6 +4,7 @@
 #include <QString>
 #include <QImage>
 #include <iostream>
+#include <memory>
 
 struct Image {
     RGBA* data;
@@ -11,4 +12,17 @@ struct Image {
     int height;
 };
 
+// Frees an Image along with its pixels, for images allocated like the ones loadImageFromFile returns.
+// Images that only view pixels owned elsewhere (such as a mapped file) use ImageDeleter{false}.
+struct ImageDeleter {
+    bool ownsData = true;
+
+    void operator()(Image* image) const {
+        if (ownsData) delete[] image->data;
+        delete image;
+    }
+};
+
+using ImagePtr = std::unique_ptr<Image, ImageDeleter>;
+
 Image* loadImageFromFile(std::string file);
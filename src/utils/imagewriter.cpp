@@ -0,0 +1,173 @@
+#include "imagewriter.h"
+#include <QSaveFile>
+
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Both formats are stored little endian, as written here.
+static_assert(std::endian::native == std::endian::little, "ImageWriter writes the host's byte order");
+
+namespace {
+
+// Appends plain values and attributes of an EXR header.
+class HeaderBuilder
+{
+public:
+    template <typename T>
+    void value(const T& value) {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        m_bytes.insert(m_bytes.end(), bytes, bytes + sizeof(T));
+    }
+
+    void string(const std::string& text) {
+        m_bytes.insert(m_bytes.end(), text.begin(), text.end());
+        m_bytes.push_back('\0');
+    }
+
+    // Starts an attribute whose value of size bytes has to follow.
+    void attribute(const std::string& name, const std::string& type, std::int32_t size) {
+        string(name);
+        string(type);
+        value(size);
+    }
+
+    const std::vector<char>& bytes() const { return m_bytes; }
+
+private:
+    std::vector<char> m_bytes;
+};
+
+} // namespace
+
+bool ImageWriter::isHDR(const QString& path) {
+
+    return path.endsWith(".pfm", Qt::CaseInsensitive) || path.endsWith(".exr", Qt::CaseInsensitive);
+
+}
+
+bool ImageWriter::write(const QString& path, const glm::vec4* pixels, int width, int height) {
+
+    if (path.endsWith(".exr", Qt::CaseInsensitive)) return writeEXR(path, pixels, width, height);
+
+    return writePFM(path, pixels, width, height);
+
+}
+
+bool ImageWriter::writePFM(const QString& path, const glm::vec4* pixels, int width, int height) {
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    // A negative scale marks little-endian floats.
+    std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+    bool ok = file.write(header.data(), header.size()) == (qint64)header.size();
+
+    std::vector<float> row(width * 3);
+    qint64 rowBytes = row.size() * sizeof(float);
+
+    for (int j = height - 1; j >= 0 && ok; j--) {
+
+        const glm::vec4* source = pixels + (std::size_t)j * width;
+        for (int i = 0; i < width; i++) {
+            row[3 * i + 0] = source[i].r;
+            row[3 * i + 1] = source[i].g;
+            row[3 * i + 2] = source[i].b;
+        }
+
+        ok = file.write(reinterpret_cast<const char*>(row.data()), rowBytes) == rowBytes;
+
+    }
+
+    return ok && file.commit();
+
+}
+
+bool ImageWriter::writeEXR(const QString& path, const glm::vec4* pixels, int width, int height) {
+
+    // Header --
+    // Channels are listed, and stored in every scanline, in alphabetical order.
+    const char* channels[3] = {"B", "G", "R"};
+    const int components[3] = {2, 1, 0};
+
+    HeaderBuilder header;
+    header.value<std::int32_t>(20000630); // Magic number
+    header.value<std::int32_t>(2);        // Version 2, single part scanline image
+
+    header.attribute("channels", "chlist", 3 * (2 + 16) + 1);
+    for (const char* channel : channels) {
+        header.string(channel);
+        header.value<std::int32_t>(2); // FLOAT
+        header.value<std::uint8_t>(0); // pLinear
+        header.value<std::uint8_t>(0);
+        header.value<std::uint16_t>(0);
+        header.value<std::int32_t>(1); // x and y sampling
+        header.value<std::int32_t>(1);
+    }
+    header.value<char>('\0');
+
+    header.attribute("compression", "compression", 1);
+    header.value<std::uint8_t>(0); // NO_COMPRESSION
+
+    for (const char* window : {"dataWindow", "displayWindow"}) {
+        header.attribute(window, "box2i", 16);
+        header.value<std::int32_t>(0);
+        header.value<std::int32_t>(0);
+        header.value<std::int32_t>(width - 1);
+        header.value<std::int32_t>(height - 1);
+    }
+
+    header.attribute("lineOrder", "lineOrder", 1);
+    header.value<std::uint8_t>(0); // INCREASING_Y
+
+    header.attribute("pixelAspectRatio", "float", 4);
+    header.value<float>(1.0f);
+
+    header.attribute("screenWindowCenter", "v2f", 8);
+    header.value<float>(0.0f);
+    header.value<float>(0.0f);
+
+    header.attribute("screenWindowWidth", "float", 4);
+    header.value<float>(1.0f);
+
+    header.value<char>('\0');
+
+    // Uncompressed scanlines all have the same size, so the offset table is known before any of them is written.
+    std::int32_t lineBytes = width * 3 * sizeof(float);
+    std::uint64_t lineStart = header.bytes().size() + (std::uint64_t)height * sizeof(std::uint64_t);
+
+    std::vector<std::uint64_t> offsets(height);
+    for (int j = 0; j < height; j++) offsets[j] = lineStart + (std::uint64_t)j * (2 * sizeof(std::int32_t) + lineBytes);
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    bool ok = true;
+    auto write = [&](const void* bytes, std::uint64_t count) {
+        ok = ok && file.write(static_cast<const char*>(bytes), count) == (qint64)count;
+    };
+
+    write(header.bytes().data(), header.bytes().size());
+    write(offsets.data(), offsets.size() * sizeof(std::uint64_t));
+
+    // Scanlines --
+    // Each one is its y, its size in bytes, then every channel's values for the whole row in turn.
+    std::vector<float> line(width * 3);
+
+    for (std::int32_t j = 0; j < height && ok; j++) {
+
+        const glm::vec4* source = pixels + (std::size_t)j * width;
+        for (int channel = 0; channel < 3; channel++) {
+            for (int i = 0; i < width; i++) line[channel * width + i] = source[i][components[channel]];
+        }
+
+        write(&j, sizeof(j));
+        write(&lineBytes, sizeof(lineBytes));
+        write(line.data(), lineBytes);
+
+    }
+
+    return ok && file.commit();
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QString>
+#include <glm/glm.hpp>
+
+// Writers for float (HDR) images, which keep colors above 1 and the full precision of the renderer for tone mapping
+// or compositing later. Rows are converted and written one at a time, so no second copy of the image is made.
+namespace ImageWriter {
+    // Whether path names an HDR format (.pfm or .exr), which write() handles instead of QImage.
+    bool isHDR(const QString& path);
+
+    // Writes the width x height linear colors of pixels (row by row, from the top) to path, in the format of its
+    // extension. The alpha channel is not stored. Returns false if the file could not be written.
+    bool write(const QString& path, const glm::vec4* pixels, int width, int height);
+
+    // Portable float map: three 32-bit floats per pixel, rows from the bottom up.
+    bool writePFM(const QString& path, const glm::vec4* pixels, int width, int height);
+
+    // OpenEXR: uncompressed scanlines of 32-bit float R, G and B channels.
+    bool writeEXR(const QString& path, const glm::vec4* pixels, int width, int height);
+} // namespace ImageWriter
@@ -19,6 +19,19 @@ SuperSamplerPattern IniUtils::superSamplerPatternFromString(const QString& str)
         return SuperSamplerPattern::Stratified;
     else if (str == "random")
         return SuperSamplerPattern::Random;
+    else if (str == "adaptive")
+        return SuperSamplerPattern::Adaptive;
     else
         throw std::runtime_error("Invalid supersampler pattern string.");
 }
+
+ToneMapOperator IniUtils::toneMapOperatorFromString(const QString& str) {
+    if (str == "clamp" || str == "none")
+        return ToneMapOperator::Clamp;
+    else if (str == "reinhard")
+        return ToneMapOperator::Reinhard;
+    else if (str == "aces")
+        return ToneMapOperator::ACES;
+    else
+        throw std::runtime_error("Invalid tone map operator string.");
+}
@@ -12,9 +12,17 @@ enum class SuperSamplerPattern {
     Grid = 0,
     Stratified = 1,
     Random = 2,
+    Adaptive = 3,
+};
+
+enum class ToneMapOperator {
+    Clamp = 0,
+    Reinhard = 1,
+    ACES = 2,
 };
 
 namespace IniUtils {
     TextureFilterType textureFilterTypeFromString(const QString& str);
     SuperSamplerPattern superSamplerPatternFromString(const QString& str);
+    ToneMapOperator toneMapOperatorFromString(const QString& str);
 } // namespace IniUtils
@@ -0,0 +1,206 @@
+#include "objreader.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+
+// One corner of an OBJ face: 0-based position, uv and normal indices, -1 where absent.
+struct Corner {
+    int position;
+    int uv;
+    int normal;
+
+    bool operator==(const Corner &other) const {
+        return position == other.position && uv == other.uv && normal == other.normal;
+    }
+};
+
+struct CornerHash {
+    std::size_t operator()(const Corner &corner) const {
+        std::uint64_t key = ((std::uint64_t)(std::uint32_t)corner.position << 32) ^
+                            ((std::uint64_t)(std::uint32_t)(corner.uv + 1) << 16) ^
+                            (std::uint64_t)(std::uint32_t)(corner.normal + 1);
+        return (std::size_t)(key * 0x9E3779B97F4A7C15ull);
+    }
+};
+
+// Resolves a 1-based (or negative, counted from the end) OBJ index against count elements.
+// Returns -1 for an absent (0) index and -2 for a negative one reaching before the first element.
+int resolveIndex(long index, int count) {
+
+    if (index > 0) return (int)index - 1;
+    if (index < 0) return (count + index >= 0) ? count + (int)index : -2;
+    return -1;
+
+}
+
+// Parses "v", "v/vt", "v//vn" or "v/vt/vn" starting at text, and advances text past it.
+bool parseCorner(const char *&text, int positionCount, int uvCount, int normalCount, Corner &corner) {
+
+    char *end;
+    long position = std::strtol(text, &end, 10);
+    if (end == text) return false;
+    text = end;
+
+    long uv = 0, normal = 0;
+
+    if (*text == '/') {
+
+        text++;
+        if (*text != '/') {
+            uv = std::strtol(text, &end, 10);
+            text = end;
+        }
+
+        if (*text == '/') {
+            text++;
+            normal = std::strtol(text, &end, 10);
+            text = end;
+        }
+
+    }
+
+    corner.position = resolveIndex(position, positionCount);
+    corner.uv = resolveIndex(uv, uvCount);
+    corner.normal = resolveIndex(normal, normalCount);
+
+    return corner.position >= 0 && corner.position < positionCount &&
+           corner.uv >= -1 && corner.uv < uvCount &&
+           corner.normal >= -1 && corner.normal < normalCount;
+
+}
+
+} // namespace
+
+bool loadMeshFromFile(const std::string &file, MeshData &mesh) {
+
+    std::ifstream stream(file);
+    if (!stream) {
+        std::cout << "Failed to open mesh: " << file << std::endl;
+        return false;
+    }
+
+    mesh = MeshData();
+
+    std::vector<glm::vec3> filePositions;
+    std::vector<glm::vec3> fileNormals;
+    std::vector<glm::vec2> fileUVs;
+
+    // Every distinct corner becomes one vertex of the output arrays.
+    std::unordered_map<Corner, int, CornerHash> vertexOf;
+    std::vector<int> filePositionOf; // Of each vertex
+
+    auto vertexIndex = [&](const Corner &corner) {
+
+        auto [it, inserted] = vertexOf.try_emplace(corner, (int)mesh.positions.size());
+        if (inserted) {
+            mesh.positions.push_back(filePositions[corner.position]);
+            filePositionOf.push_back(corner.position);
+            mesh.normals.push_back(corner.normal >= 0 ? fileNormals[corner.normal] : glm::vec3(0.0f));
+            mesh.uvs.push_back(corner.uv >= 0 ? fileUVs[corner.uv] : glm::vec2(0.0f));
+        }
+
+        return it->second;
+
+    };
+
+    bool missingNormals = false;
+    std::vector<int> face;
+    std::string line;
+    int lineNumber = 0;
+
+    while (std::getline(stream, line)) {
+
+        lineNumber++;
+        const char *text = line.c_str();
+        while (*text == ' ' || *text == '\t') text++;
+
+        if (text[0] == 'v' && (text[1] == ' ' || text[1] == '\t')) {
+
+            char *end;
+            float x = std::strtof(text + 2, &end);
+            float y = std::strtof(end, &end);
+            float z = std::strtof(end, &end);
+            filePositions.push_back(glm::vec3(x, y, z));
+
+        } else if (text[0] == 'v' && text[1] == 'n') {
+
+            char *end;
+            float x = std::strtof(text + 2, &end);
+            float y = std::strtof(end, &end);
+            float z = std::strtof(end, &end);
+            fileNormals.push_back(glm::vec3(x, y, z));
+
+        } else if (text[0] == 'v' && text[1] == 't') {
+
+            char *end;
+            float u = std::strtof(text + 2, &end);
+            float v = std::strtof(end, &end);
+            fileUVs.push_back(glm::vec2(u, v));
+
+        } else if (text[0] == 'f' && (text[1] == ' ' || text[1] == '\t')) {
+
+            face.clear();
+            text += 2;
+
+            while (true) {
+
+                while (*text == ' ' || *text == '\t' || *text == '\r') text++;
+                if (*text == '\0') break;
+
+                Corner corner;
+                if (!parseCorner(text, (int)filePositions.size(), (int)fileUVs.size(), (int)fileNormals.size(), corner)) {
+                    std::cout << "Invalid face on line " << lineNumber << " of mesh: " << file << std::endl;
+                    return false;
+                }
+
+                missingNormals = missingNormals || corner.normal < 0;
+                face.push_back(vertexIndex(corner));
+
+            }
+
+            // Triangle Fan --
+            for (int i = 2; i < (int)face.size(); i++) {
+                mesh.triangles.push_back(glm::ivec3(face[0], face[i - 1], face[i]));
+            }
+
+        }
+
+    }
+
+    if (mesh.triangles.empty()) {
+        std::cout << "Mesh has no faces: " << file << std::endl;
+        return false;
+    }
+
+    // Smooth Normals --
+    // Vertices without a normal in the file get the area-weighted average of the faces around their file position.
+    // Faces are summed per position rather than per vertex, so vertices split at a UV seam get the same normal.
+    if (missingNormals) {
+
+        std::vector<glm::vec3> accumulated(filePositions.size(), glm::vec3(0.0f));
+
+        for (const glm::ivec3 &triangle : mesh.triangles) {
+
+            glm::vec3 faceNormal = glm::cross(mesh.positions[triangle[1]] - mesh.positions[triangle[0]],
+                                              mesh.positions[triangle[2]] - mesh.positions[triangle[0]]);
+            for (int corner = 0; corner < 3; corner++) accumulated[filePositionOf[triangle[corner]]] += faceNormal;
+
+        }
+
+        for (int vertex = 0; vertex < (int)mesh.normals.size(); vertex++) {
+
+            const glm::vec3 &sum = accumulated[filePositionOf[vertex]];
+            if (mesh.normals[vertex] == glm::vec3(0.0f) && glm::dot(sum, sum) > 0.0f) mesh.normals[vertex] = glm::normalize(sum);
+
+        }
+
+    }
+
+    return true;
+
+}
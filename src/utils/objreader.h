@@ -0,0 +1,19 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Triangles of a Wavefront OBJ file, with one entry in positions/normals/uvs per distinct
+// (position, uv, normal) corner of the file, so every triangle indexes all three arrays the same way.
+struct MeshData {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;   // Per vertex; computed from the faces when the file has none
+    std::vector<glm::vec2> uvs;       // Per vertex; (0, 0) when the file has none
+    std::vector<glm::ivec3> triangles;
+};
+
+// Loads the faces of an OBJ file into mesh. Polygons are split into triangle fans, and
+// everything but vertices, texture coordinates, normals and faces is ignored.
+// @return True if the file was read and holds at least one triangle, False otherwise.
+bool loadMeshFromFile(const std::string &file, MeshData &mesh);
@@ -160,8 +160,43 @@ struct SceneTransformation {
     glm::mat4 matrix;    // Only applicable when transforming by a custom matrix. This is that custom matrix.
 };
 
+// Struct which contains one keyframe of an animated group. The keyed transform is applied inside the group,
+// after its own transformations: translate * rotate * scale.
+struct SceneKeyframe {
+    float frame;
+
+    glm::vec3 translate = glm::vec3(0.0f);
+    glm::vec3 rotate = glm::vec3(0.0f, 1.0f, 0.0f); // Axis of rotation
+    float angle = 0.0f;                             // In RADIANS; keys may differ by more than a full turn
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// Struct which contains one keyframe of the camera. Omitted fields keep the values of the scene's cameraData.
+struct SceneCameraKeyframe {
+    float frame;
+
+    glm::vec4 pos;
+    glm::vec4 look;
+    glm::vec4 up;
+};
+
+// Struct which contains the keyframes of every group with a given name
+struct SceneAnimationTrack {
+    std::string group;
+    std::vector<SceneKeyframe> keys; // Sorted by frame
+};
+
+// Struct which contains the animation of a scene: frames [0, frameCount) of keyframed camera and group transforms.
+// Values between keys are interpolated linearly; before the first and after the last key they are held.
+struct SceneAnimation {
+    int frameCount = 1;
+    std::vector<SceneCameraKeyframe> camera; // Sorted by frame; empty for a fixed camera
+    std::vector<SceneAnimationTrack> tracks;
+};
+
 // Struct which represents a node in the scene graph/tree, to be parsed by the student's `SceneParser`.
 struct SceneNode {
+    std::string name; // Empty for unnamed groups
     std::vector<SceneTransformation*> transformations; // Note the order of transformations described in lab 5
     std::vector<ScenePrimitive*> primitives;
     std::vector<SceneLight*> lights;
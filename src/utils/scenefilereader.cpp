@@ -3,6 +3,7 @@
 
 #include "glm/gtc/type_ptr.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iostream>
@@ -65,6 +66,14 @@ SceneNode *ScenefileReader::getRootNode() const {
     return m_root;
 }
 
+const std::map<std::string, SceneNode *> &ScenefileReader::getTemplates() const {
+    return m_templates;
+}
+
+SceneAnimation ScenefileReader::getAnimation() const {
+    return m_animation;
+}
+
 // This is where it all goes down...
 bool ScenefileReader::readJSON() {
     // Read the file
@@ -104,7 +113,7 @@ bool ScenefileReader::readJSON() {
     }
 
     QStringList requiredFields = {"globalData", "cameraData"};
-    QStringList optionalFields = {"name", "groups", "templateGroups"};
+    QStringList optionalFields = {"name", "groups", "templateGroups", "animation"};
     // If other fields are present, raise an error
     QStringList allFields = requiredFields + optionalFields;
     for (auto &field : scenefile.keys()) {
@@ -140,6 +149,14 @@ bool ScenefileReader::readJSON() {
         }
     }
 
+    // Parse the animation; camera keyframes default to the camera data parsed above
+    if (scenefile.contains("animation")) {
+        if (!scenefile["animation"].isObject() || !parseAnimation(scenefile["animation"].toObject())) {
+            std::cout << "could not parse \"animation\"" << std::endl;
+            return false;
+        }
+    }
+
     std::cout << "Finished reading " << file_name << std::endl;
     return true;
 }
@@ -516,6 +533,174 @@ bool ScenefileReader::parseCameraData(const QJsonObject &cameradata) {
     return true;
 }
 
+/**
+ * Reads object[field] into values if it is an array of count floating-point values.
+ */
+static bool parseFloatArray(const QJsonObject &object, const QString &field, int count, float *values, const std::string &owner) {
+    if (!object[field].isArray() || object[field].toArray().size() != count) {
+        std::cout << owner << " " << field.toStdString() << " must be an array of " << count << " elements" << std::endl;
+        return false;
+    }
+
+    QJsonArray array = object[field].toArray();
+    for (int i = 0; i < count; i++) {
+        if (!array[i].isDouble()) {
+            std::cout << owner << " " << field.toStdString() << " must contain floating-point values" << std::endl;
+            return false;
+        }
+        values[i] = array[i].toDouble();
+    }
+
+    return true;
+}
+
+/**
+ * Parse the animation object into m_animation.
+ */
+bool ScenefileReader::parseAnimation(const QJsonObject &animation) {
+    QStringList requiredFields = {"frames"};
+    QStringList optionalFields = {"camera", "groups"};
+    QStringList allFields = requiredFields + optionalFields;
+    for (auto &field : animation.keys()) {
+        if (!allFields.contains(field)) {
+            std::cout << "unknown field \"" << field.toStdString() << "\" on animation object" << std::endl;
+            return false;
+        }
+    }
+
+    if (!animation["frames"].isDouble() || animation["frames"].toInt() < 1) {
+        std::cout << "animation frames must be a positive integer" << std::endl;
+        return false;
+    }
+    m_animation.frameCount = animation["frames"].toInt();
+
+    auto byFrame = [](const auto &a, const auto &b) { return a.frame < b.frame; };
+
+    if (animation.contains("camera")) {
+        if (!animation["camera"].isArray()) {
+            std::cout << "animation camera must be an array of keyframes" << std::endl;
+            return false;
+        }
+
+        for (auto keyframe : animation["camera"].toArray()) {
+            SceneCameraKeyframe key;
+            if (!keyframe.isObject() || !parseCameraKeyframe(keyframe.toObject(), key)) {
+                std::cout << "could not parse animation camera keyframe" << std::endl;
+                return false;
+            }
+            m_animation.camera.push_back(key);
+        }
+
+        std::stable_sort(m_animation.camera.begin(), m_animation.camera.end(), byFrame);
+    }
+
+    if (animation.contains("groups")) {
+        if (!animation["groups"].isArray()) {
+            std::cout << "animation groups must be an array" << std::endl;
+            return false;
+        }
+
+        for (auto group : animation["groups"].toArray()) {
+            QJsonObject groupData = group.toObject();
+            if (!groupData["name"].isString() || !groupData["keys"].isArray()) {
+                std::cout << "animation groups must have a string \"name\" and an array of \"keys\"" << std::endl;
+                return false;
+            }
+
+            SceneAnimationTrack track;
+            track.group = groupData["name"].toString().toStdString();
+
+            for (auto keyframe : groupData["keys"].toArray()) {
+                SceneKeyframe key;
+                if (!keyframe.isObject() || !parseKeyframe(keyframe.toObject(), key)) {
+                    std::cout << "could not parse keyframe of animated group \"" << track.group << "\"" << std::endl;
+                    return false;
+                }
+                track.keys.push_back(key);
+            }
+
+            if (track.keys.empty()) {
+                std::cout << "animated group \"" << track.group << "\" has no keys" << std::endl;
+                return false;
+            }
+
+            std::stable_sort(track.keys.begin(), track.keys.end(), byFrame);
+            m_animation.tracks.push_back(track);
+        }
+    }
+
+    return true;
+}
+
+bool ScenefileReader::parseCameraKeyframe(const QJsonObject &keyframe, SceneCameraKeyframe &key) {
+    QStringList allFields = {"frame", "position", "look", "up"};
+    for (auto &field : keyframe.keys()) {
+        if (!allFields.contains(field)) {
+            std::cout << "unknown field \"" << field.toStdString() << "\" on camera keyframe" << std::endl;
+            return false;
+        }
+    }
+
+    if (!keyframe["frame"].isDouble()) {
+        std::cout << "camera keyframe frame must be a number" << std::endl;
+        return false;
+    }
+    key.frame = keyframe["frame"].toDouble();
+
+    key.pos = m_cameraData.pos;
+    key.look = m_cameraData.look;
+    key.up = m_cameraData.up;
+
+    float values[3];
+    if (keyframe.contains("position")) {
+        if (!parseFloatArray(keyframe, "position", 3, values, "camera keyframe")) return false;
+        key.pos = glm::vec4(values[0], values[1], values[2], m_cameraData.pos.w);
+    }
+    if (keyframe.contains("look")) {
+        if (!parseFloatArray(keyframe, "look", 3, values, "camera keyframe")) return false;
+        key.look = glm::vec4(values[0], values[1], values[2], m_cameraData.look.w);
+    }
+    if (keyframe.contains("up")) {
+        if (!parseFloatArray(keyframe, "up", 3, values, "camera keyframe")) return false;
+        key.up = glm::vec4(values[0], values[1], values[2], m_cameraData.up.w);
+    }
+
+    return true;
+}
+
+bool ScenefileReader::parseKeyframe(const QJsonObject &keyframe, SceneKeyframe &key) {
+    QStringList allFields = {"frame", "translate", "rotate", "scale"};
+    for (auto &field : keyframe.keys()) {
+        if (!allFields.contains(field)) {
+            std::cout << "unknown field \"" << field.toStdString() << "\" on keyframe" << std::endl;
+            return false;
+        }
+    }
+
+    if (!keyframe["frame"].isDouble()) {
+        std::cout << "keyframe frame must be a number" << std::endl;
+        return false;
+    }
+    key.frame = keyframe["frame"].toDouble();
+
+    float values[4];
+    if (keyframe.contains("translate")) {
+        if (!parseFloatArray(keyframe, "translate", 3, values, "keyframe")) return false;
+        key.translate = glm::vec3(values[0], values[1], values[2]);
+    }
+    if (keyframe.contains("rotate")) {
+        if (!parseFloatArray(keyframe, "rotate", 4, values, "keyframe")) return false;
+        key.rotate = glm::vec3(values[0], values[1], values[2]);
+        key.angle = values[3] * M_PI / 180.f;
+    }
+    if (keyframe.contains("scale")) {
+        if (!parseFloatArray(keyframe, "scale", 3, values, "keyframe")) return false;
+        key.scale = glm::vec3(values[0], values[1], values[2]);
+    }
+
+    return true;
+}
+
 bool ScenefileReader::parseTemplateGroups(const QJsonValue &templateGroups) {
     if (!templateGroups.isArray()) {
         std::cout << "templateGroups must be an array" << std::endl;
@@ -583,6 +768,11 @@ bool ScenefileReader::parseGroupData(const QJsonObject &object, SceneNode *node)
         }
     }
 
+    // keep the name, so animation tracks can find the group
+    if (object["name"].isString()) {
+        node->name = object["name"].toString().toStdString();
+    }
+
     // parse translation if defined
     if (object.contains("translate")) {
         if (!object["translate"].isArray()) {
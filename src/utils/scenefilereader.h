@@ -26,6 +26,12 @@ public:
 
     SceneNode *getRootNode() const;
 
+    // The nodes of the file's templateGroups by name. Every group referencing a template has the same node as its child.
+    const std::map<std::string, SceneNode *> &getTemplates() const;
+
+    // Keyframes of the optional "animation" object; a single still frame if the file has none.
+    SceneAnimation getAnimation() const;
+
 private:
     // The filename should be contained within this parser implementation.
     // If you want to parse a new file, instantiate a different parser.
@@ -37,6 +43,9 @@ private:
     bool parseGroupData(const QJsonObject &object, SceneNode *node);
     bool parsePrimitive(const QJsonObject &prim, SceneNode *node);
     bool parseLightData(const QJsonObject &lightData, SceneNode *node);
+    bool parseAnimation(const QJsonObject &animation);
+    bool parseCameraKeyframe(const QJsonObject &keyframe, SceneCameraKeyframe &key);
+    bool parseKeyframe(const QJsonObject &keyframe, SceneKeyframe &key);
 
     std::string file_name;
 
@@ -44,6 +53,7 @@ private:
 
     SceneGlobalData m_globalData;
     SceneCameraData m_cameraData;
+    SceneAnimation m_animation;
 
     SceneNode *m_root;
     std::vector<SceneNode *> m_nodes;
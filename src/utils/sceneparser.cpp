@@ -4,12 +4,10 @@
 
 #include <chrono>
 #include <iostream>
+#include <map>
 
-void nodeTraversal(SceneNode* node, RenderData &renderData, glm::mat4 ctm) {
-
-    if (node == NULL) {
-        return;
-    }
+// The transformations of a group, combined in order.
+glm::mat4 nodeTransform(const SceneNode* node) {
 
     glm::mat4 culCTM = glm::mat4(1.0f);
 
@@ -30,21 +28,117 @@ void nodeTraversal(SceneNode* node, RenderData &renderData, glm::mat4 ctm) {
         }
     }
 
+    return culCTM;
+
+}
+
+void addLight(const SceneLight* light, RenderData &renderData, const glm::mat4 &ctm, const AnimationPath &path) {
+
+    glm::vec4 lightPos = {0, 0, 0, 1};
+    SceneLightData lighting = {light->id, light->type, light->color, light->function, ctm * lightPos, ctm * light->dir, light->penumbra, light->angle, light->width, light->height};
+    renderData.lights.push_back(lighting);
+    renderData.lightAnimation.push_back(RenderLightAnimation{path, light->dir});
+
+}
+
+// Returns true if node or any group below it has an animation track.
+bool isAnimated(const SceneNode* node, const SceneAnimation &animation) {
+
+    if (!node->name.empty() && Animation::findTrack(animation, node->name) >= 0) return true;
+
+    for (const SceneNode* child : node->children) {
+        if (isAnimated(child, animation)) return true;
+    }
+
+    return false;
+
+}
+
+// Where each templateGroup node went in RenderData::templates, -1 until it is first placed. Templates with animated
+// groups inside are not listed: each copy of those moves on its own, so they are flattened like any other group.
+using TemplateIndices = std::map<const SceneNode*, int>;
+
+// Adds the lights under an instanced template. Lights stay flattened, one per instance, since shading loops over them.
+void placeLights(SceneNode* node, RenderData &renderData, glm::mat4 ctm, AnimationPath path) {
+
+    glm::mat4 culCTM = nodeTransform(node);
     ctm *= culCTM;
 
+    if (path.isAnimated()) path.segments.back().after *= culCTM;
+    else path.base = ctm;
+
+    for (SceneLight* light : node->lights) addLight(light, renderData, ctm, path);
+
+    for (SceneNode* child : node->children) placeLights(child, renderData, ctm, path);
+
+}
+
+void nodeTraversal(SceneNode* node, RenderData &renderData, glm::mat4 ctm, AnimationPath path, TemplateIndices* templates);
+
+// Returns the index of node's template, flattening its primitives into template space the first time.
+// Templates nested inside it are flattened too: there are only two levels.
+int templateIndex(SceneNode* node, RenderData &renderData, TemplateIndices &templates) {
+
+    int &index = templates[node];
+    if (index >= 0) return index;
+
+    RenderData contents;
+    contents.animation = renderData.animation;
+    nodeTraversal(node, contents, glm::mat4(1.0f), AnimationPath(), nullptr);
+
+    index = (int)renderData.templates.size();
+    renderData.templates.push_back(RenderTemplateData{std::move(contents.shapes)});
+
+    return index;
+
+}
+
+// path holds the animated groups above node, split as described by AnimationPath.
+// Children that are listed in templates are placed as instances instead of being flattened; null flattens everything.
+void nodeTraversal(SceneNode* node, RenderData &renderData, glm::mat4 ctm, AnimationPath path, TemplateIndices* templates) {
+
+    if (node == NULL) {
+        return;
+    }
+
+    glm::mat4 culCTM = nodeTransform(node);
+    ctm *= culCTM;
+
+    if (path.isAnimated()) path.segments.back().after *= culCTM;
+    else path.base = ctm;
+
+    // An animated group adds its keyed transform (at frame 0 here) inside its own transformations.
+    int track = node->name.empty() ? -1 : Animation::findTrack(renderData.animation, node->name);
+    if (track >= 0) {
+        ctm *= Animation::transform(renderData.animation.tracks[track], 0.0f);
+        path.segments.push_back(AnimationPath::Segment{track, glm::mat4(1.0f)});
+    }
+
     for (ScenePrimitive* prim : node->primitives) {
-        RenderShapeData primitive = {*prim, ctm};
+        RenderShapeData primitive = {*prim, ctm, path};
         renderData.shapes.push_back(primitive);
     }
 
     for (SceneLight* light : node->lights) {
-        glm::vec4 lightPos = {0, 0, 0, 1};
-        SceneLightData lighting = {light->id, light->type, light->color, light->function, ctm * lightPos, ctm * light->dir, light->penumbra, light->angle, light->width, light->height};
-        renderData.lights.push_back(lighting);
+        addLight(light, renderData, ctm, path);
     }
 
     for (SceneNode* child : node->children) {
-        nodeTraversal(child, renderData, ctm);
+
+        if (templates && templates->contains(child)) {
+
+            int index = templateIndex(child, renderData, *templates);
+            if (!renderData.templates[index].shapes.empty()) {
+                renderData.instances.push_back(RenderInstanceData{index, ctm, path});
+            }
+
+            placeLights(child, renderData, ctm, path);
+            continue;
+
+        }
+
+        nodeTraversal(child, renderData, ctm, path, templates);
+
     }
 
 }
@@ -58,7 +152,8 @@ bool SceneParser::parse(std::string filepath, RenderData &renderData) {
     }
 
     // Task 5: populate renderData with global data, and camera data;
-    renderData.cameraData = fileReader.getCameraData();
+    renderData.animation = fileReader.getAnimation();
+    renderData.cameraData = Animation::camera(renderData.animation, fileReader.getCameraData(), 0.0f);
     renderData.globalData = fileReader.getGlobalData();
 
     // Task 6: populate renderData's list of primitives and their transforms.
@@ -67,8 +162,17 @@ bool SceneParser::parse(std::string filepath, RenderData &renderData) {
 
     auto rootNode = fileReader.getRootNode();
     renderData.shapes.clear();
+    renderData.lights.clear();
+    renderData.lightAnimation.clear();
+    renderData.templates.clear();
+    renderData.instances.clear();
+
+    TemplateIndices templates;
+    for (const auto &[name, node] : fileReader.getTemplates()) {
+        if (!isAnimated(node, renderData.animation)) templates[node] = -1;
+    }
 
-    nodeTraversal(rootNode, renderData, glm::mat4(1.0f));
+    nodeTraversal(rootNode, renderData, glm::mat4(1.0f), AnimationPath(), &templates);
 
     return true;
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "scenedata.h"
+#include "animation.h"
 #include <vector>
 #include <string>
 
@@ -8,6 +9,25 @@
 struct RenderShapeData {
     ScenePrimitive primitive;
     glm::mat4 ctm; // the cumulative transformation matrix
+    AnimationPath animation; // How ctm changes from frame to frame
+};
+
+// Struct which contains what is needed to move a light with the groups above it
+struct RenderLightAnimation {
+    AnimationPath path;
+    glm::vec4 dir; // Direction before the CTM is applied
+};
+
+// Struct which contains the primitives of a templateGroup, in the template's own space
+struct RenderTemplateData {
+    std::vector<RenderShapeData> shapes;
+};
+
+// Struct which contains one placement of a template
+struct RenderInstanceData {
+    int templateIndex; // Index into RenderData::templates
+    glm::mat4 ctm;     // From the template's space to world space
+    AnimationPath animation;
 };
 
 // Struct which contains all the data needed to render a scene
@@ -17,6 +37,14 @@ struct RenderData {
 
     std::vector<SceneLightData> lights;
     std::vector<RenderShapeData> shapes;
+
+    // Everything above is frame 0 of the animation. lightAnimation runs parallel to lights.
+    SceneAnimation animation;
+    std::vector<RenderLightAnimation> lightAnimation;
+
+    // Templates are kept once and placed by reference, rather than copied into shapes for every group using them.
+    std::vector<RenderTemplateData> templates;
+    std::vector<RenderInstanceData> instances;
 };
 
 class SceneParser {